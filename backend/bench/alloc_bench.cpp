@@ -0,0 +1,127 @@
+// Counts heap allocations spent preparing MongoDB queries on the hot paths, comparing the stream
+// builder and per-call collection lookups with BsonFilter and the lease's reused collection handles.
+//
+// Usage: roommate_alloc_bench [--iterations N]
+//
+// Nothing is sent to the server; pooled clients connect lazily, so no mongod is needed.
+// Only C++ allocations are counted: libbson's own buffers, which the stream builder also
+// allocates, come on top of the "before" column.
+
+#include "BsonFilter.h"
+#include "DBManager.h"
+
+#include <bsoncxx/builder/stream/document.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/pool.hpp>
+#include <mongocxx/uri.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::finalize;
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+/**
+ * Runs `op` `iterations` times and returns the average number of allocations per call.
+ */
+static double allocationsPer(const std::function<void()>& op, int iterations) {
+    op();  // Warm up lazily created state
+    uint64_t before = allocations.load();
+    for (int i = 0; i < iterations; ++i) op();
+    return static_cast<double>(allocations.load() - before) / iterations;
+}
+
+static void report(const char* name, double before, double after) {
+    std::cout << std::left << std::setw(24) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << before << std::setw(10) << after << "\n";
+}
+
+int main(int argc, char** argv) {
+    int iterations = 100000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = std::max(1, std::atoi(argv[++i]));
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--iterations N]\n";
+            return 1;
+        }
+    }
+
+    const bsoncxx::oid id;
+    const std::string source = id.to_string();
+    const std::string target = bsoncxx::oid().to_string();
+    const std::string country = "USA";
+    const std::string city = "San Francisco";
+
+    std::cout << std::left << std::setw(24) << "allocations per call"
+              << std::right << std::setw(10) << "before" << std::setw(10) << "after" << "\n";
+
+    double idBefore = allocationsPer([&] {
+        auto filter = document{} << "_id" << id << finalize;
+    }, iterations);
+    double idAfter = allocationsPer([&] {
+        BsonFilter filter;
+        filter.append("_id", id).view();
+    }, iterations);
+    report("_id filter", idBefore, idAfter);
+
+    double mutualBefore = allocationsPer([&] {
+        auto filter = document{} << "sourceEntityId" << target << "targetEntityId" << source << finalize;
+    }, iterations);
+    double mutualAfter = allocationsPer([&] {
+        BsonFilter filter;
+        filter.append("sourceEntityId", target).append("targetEntityId", source).view();
+    }, iterations);
+    report("mutual-like filter", mutualBefore, mutualAfter);
+
+    double cityBefore = allocationsPer([&] {
+        auto filter = document{} << "country" << country << "city" << city << finalize;
+    }, iterations);
+    double cityAfter = allocationsPer([&] {
+        BsonFilter filter;
+        filter.append("country", country).append("city", city).view();
+    }, iterations);
+    report("city filter", cityBefore, cityAfter);
+
+    // Also creates the driver instance the raw pool below needs
+    auto& manager = getDbManager();
+
+    // Before: every lease looked up the database and each getter built a fresh collection.
+    // A lease typically reaches the same collection a few times, e.g. a check and then a write.
+    mongocxx::pool pool{mongocxx::uri{"mongodb://localhost:27017/?maxPoolSize=1"}};
+    double handleBefore = allocationsPer([&] {
+        auto entry = pool.acquire();
+        auto db = (*entry)["roommatefinder"];
+        for (int i = 0; i < 3; ++i) {
+            auto users = db["users"];
+        }
+    }, iterations / 10);
+    double handleAfter = allocationsPer([&] {
+        auto lease = manager.acquire();
+        for (int i = 0; i < 3; ++i) {
+            auto& users = lease.getUserCollection();
+            (void)users;
+        }
+    }, iterations / 10);
+    report("lease + collection", handleBefore, handleAfter);
+
+    // What a findEntity() call spends before the query goes out
+    report("findEntity request", handleBefore + idBefore, handleAfter + idAfter);
+    return 0;
+}
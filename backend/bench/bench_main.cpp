@@ -0,0 +1,142 @@
+// Closed-loop benchmark of the API functions behind the HTTP routes, against either storage backend.
+//
+// Usage: roommate_bench [--storage mongo|memory] [--fixture FILE] [--op NAME|all]
+//                       [--threads N] [--seconds N]
+//
+// --fixture implies --storage memory; generate one with bench/make_fixture.py. With the memory
+// backend the numbers are the API's own CPU cost, with no database in the loop. Operations:
+// recommend, likes, swipe, rank, info. Each thread calls the operation back to back on random
+// users from the store and the run reports throughput and latency percentiles per operation.
+
+#include "Matcher.h"
+#include "PopularityAggregator.h"
+#include "Recommender.h"
+#include "Storage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchOptions {
+    std::string op = "all";
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    int seconds = 5;
+};
+
+using BenchOp = std::function<void(std::mt19937_64&)>;
+
+/**
+ * Runs `op` on every thread for the configured duration and prints its latency distribution.
+ * @param name The operation name for the report.
+ * @param op The operation; receives the calling thread's random generator.
+ * @param options The thread count and duration.
+ */
+static void runOp(const std::string& name, const BenchOp& op, const BenchOptions& options) {
+    std::atomic<bool> stop{false};
+    std::vector<std::vector<uint32_t>> latencies(options.threads);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < options.threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            auto& samples = latencies[t];
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto begin = std::chrono::steady_clock::now();
+                op(rng);
+                auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+                samples.push_back(static_cast<uint32_t>(micros));
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    stop = true;
+    for (auto& worker : workers) worker.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint32_t> all;
+    for (auto& samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+    if (all.empty()) {
+        std::cout << std::left << std::setw(10) << name << " no samples\n";
+        return;
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]; };
+
+    std::cout << std::left << std::setw(10) << name
+              << std::right << std::setw(10) << all.size() << " ops"
+              << std::setw(12) << std::fixed << std::setprecision(0) << all.size() / elapsed << " ops/s"
+              << "   p50 " << std::setw(7) << percentile(0.50) << "us"
+              << "   p99 " << std::setw(7) << percentile(0.99) << "us"
+              << "   max " << std::setw(7) << all.back() << "us\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--storage") == 0 && hasValue) setenv("ROOMMATE_STORAGE", argv[++i], 1);
+        else if (std::strcmp(argv[i], "--fixture") == 0 && hasValue) {
+            setenv("ROOMMATE_STORAGE", "memory", 1);
+            setenv("ROOMMATE_FIXTURE", argv[++i], 1);
+        }
+        else if (std::strcmp(argv[i], "--op") == 0 && hasValue) options.op = argv[++i];
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) options.threads = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--seconds") == 0 && hasValue) options.seconds = std::max(1, std::atoi(argv[++i]));
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--storage mongo|memory] [--fixture FILE] [--op NAME|all]"
+                      << " [--threads N] [--seconds N]\n";
+            return 1;
+        }
+    }
+
+    std::vector<std::string> userIds;
+    try {
+        for (auto& profile : getStorage().loadProfiles()) userIds.push_back(std::move(profile.id));
+    } catch (const std::exception& e) {
+        std::cerr << "Cannot open storage: " << e.what() << std::endl;
+        return 1;
+    }
+    if (userIds.size() < 2) {
+        std::cerr << "The store needs at least two users to benchmark" << std::endl;
+        return 1;
+    }
+
+    auto randomUser = [&](std::mt19937_64& rng) -> const std::string& {
+        return userIds[rng() % userIds.size()];
+    };
+
+    std::vector<std::pair<std::string, BenchOp>> ops = {
+        {"recommend", [&](std::mt19937_64& rng) { getRecommendations(randomUser(rng), "roommate"); }},
+        {"likes",     [&](std::mt19937_64& rng) { getUserWhoLikedEntity(randomUser(rng), "roommate"); }},
+        {"swipe",     [&](std::mt19937_64& rng) { processSwipe(randomUser(rng), randomUser(rng), "roommate", rng() % 2 == 0); }},
+        {"rank",      [&](std::mt19937_64& rng) { rankUsers(randomUser(rng), "roommate"); }},
+        {"info",      [&](std::mt19937_64& rng) { fetchUserInfo(randomUser(rng)); }},
+    };
+
+    std::cout << userIds.size() << " users, " << options.threads << " threads, "
+              << options.seconds << "s per operation\n";
+    bool ran = false;
+    for (const auto& [name, op] : ops) {
+        if (options.op != "all" && options.op != name) continue;
+        runOp(name, op, options);
+        ran = true;
+    }
+    if (!ran) {
+        std::cerr << "Unknown operation: " << options.op << std::endl;
+        return 1;
+    }
+
+    getPopularityAggregator().stop();
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Serialization microbenchmark on the API's response shapes.
+//
+// Usage: roommate_json_bench [--iterations N]
+//
+// Compares crow's original byte-at-a-time escaping with the current crow::json::escape (SSE2 scan
+// over runs that need no escaping, when the compiler targets SSE2), and a full /api/recommend
+// body of ten entities built as a wvalue tree and dumped versus written with JsonWriter.
+
+#include "JsonWriter.h"
+
+#include <crow/crow_all.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// crow::json::escape as shipped, kept as the baseline
+static void escapeBytewise(const std::string& str, std::string& ret) {
+    static const char hex[] = "0123456789abcdef";
+    ret.reserve(ret.size() + str.size() + str.size() / 4);
+    for (auto c : str) {
+        switch (c) {
+            case '"': ret += "\\\""; break;
+            case '\\': ret += "\\\\"; break;
+            case '\n': ret += "\\n"; break;
+            case '\b': ret += "\\b"; break;
+            case '\f': ret += "\\f"; break;
+            case '\r': ret += "\\r"; break;
+            case '\t': ret += "\\t"; break;
+            default:
+                if (c >= 0 && c < 0x20) {
+                    ret += "\\u00";
+                    ret += hex[c / 16];
+                    ret += hex[c % 16];
+                } else {
+                    ret += c;
+                }
+                break;
+        }
+    }
+}
+
+struct EntityFields {
+    std::string id, username, firstName, lastName, address, address_line, city, state, country, zipcode, phone, budget;
+    double popularity;
+};
+
+/// Ten entities shaped like the fixture data, with the odd field that does need escaping.
+static std::vector<EntityFields> sampleEntities() {
+    std::vector<EntityFields> entities;
+    for (int i = 0; i < 10; ++i) {
+        std::string n = std::to_string(1000 + i * 37);
+        entities.push_back({
+            "6553f13f88c780f6907f" + n,
+            "user" + n,
+            "First" + n,
+            i == 3 ? "O\"Brien" : "Last" + n,
+            n + " Main Street",
+            i % 2 ? "Unit " + std::to_string(i) : "",
+            "San Francisco",
+            "California",
+            "USA",
+            "941" + n.substr(0, 2),
+            "555-000" + n,
+            "$" + n,
+            0.015384615384615385 * (i + 1),
+        });
+    }
+    return entities;
+}
+
+static std::string wvalueBody(const std::vector<EntityFields>& entities) {
+    crow::json::wvalue result;
+    result["entity"] = crow::json::wvalue::list();
+    for (size_t i = 0; i < entities.size(); ++i) {
+        const auto& e = entities[i];
+        crow::json::wvalue entity;
+        entity["id"] = e.id;
+        entity["username"] = e.username;
+        entity["firstName"] = e.firstName;
+        entity["lastName"] = e.lastName;
+        entity["address"] = e.address;
+        entity["address_line"] = e.address_line;
+        entity["city"] = e.city;
+        entity["state"] = e.state;
+        entity["country"] = e.country;
+        entity["zipcode"] = e.zipcode;
+        entity["phone"] = e.phone;
+        entity["budget"] = e.budget;
+        entity["popularity"] = e.popularity;
+        result["entity"][i] = std::move(entity);
+    }
+    return result.dump();
+}
+
+static std::string writerBody(const std::vector<EntityFields>& entities) {
+    JsonWriter json(32 + entities.size() * 384);
+    json.beginObject().key("entity").beginArray();
+    for (const auto& e : entities) {
+        json.beginObject();
+        json.field("id", e.id);
+        json.field("username", e.username);
+        json.field("firstName", e.firstName);
+        json.field("lastName", e.lastName);
+        json.field("address", e.address);
+        json.field("address_line", e.address_line);
+        json.field("city", e.city);
+        json.field("state", e.state);
+        json.field("country", e.country);
+        json.field("zipcode", e.zipcode);
+        json.field("phone", e.phone);
+        json.field("budget", e.budget);
+        json.field("popularity", e.popularity);
+        json.endObject();
+    }
+    json.endArray().endObject();
+    return json.release();
+}
+
+/**
+ * Runs `op` `iterations` times and returns the average nanoseconds per call.
+ */
+static double nanosPer(const std::function<void()>& op, int iterations) {
+    op();  // Warm up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) op();
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    return elapsed.count() / iterations;
+}
+
+static void report(const char* name, double before, double after) {
+    std::cout << std::left << std::setw(36) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << before << std::setw(12) << after
+              << std::setw(9) << std::setprecision(2) << before / after << "x\n";
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = std::max(1, std::atoi(argv[++i]));
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--iterations N]\n";
+            return 1;
+        }
+    }
+
+    auto entities = sampleEntities();
+    std::vector<std::string> fields;
+    for (const auto& e : entities) {
+        for (const auto* field : {&e.id, &e.username, &e.firstName, &e.lastName, &e.address, &e.address_line,
+                                  &e.city, &e.state, &e.country, &e.zipcode, &e.phone, &e.budget}) {
+            fields.push_back(*field);
+        }
+    }
+
+    // Both escapers must agree before their speed means anything
+    for (const auto& field : fields) {
+        std::string expected, actual;
+        escapeBytewise(field, expected);
+        crow::json::escape(field, actual);
+        if (expected != actual) {
+            std::cerr << "Escaping mismatch on " << field << "\n";
+            return 1;
+        }
+    }
+
+#ifdef CROW_JSON_ESCAPE_SSE2
+    std::cout << "crow::json::escape: SSE2\n";
+#else
+    std::cout << "crow::json::escape: scalar\n";
+#endif
+    std::cout << std::left << std::setw(36) << "ns per call"
+              << std::right << std::setw(12) << "before" << std::setw(12) << "after" << std::setw(10) << "speedup" << "\n";
+
+    std::string out;
+    double escapeBefore = nanosPer([&] {
+        out.clear();
+        for (const auto& field : fields) escapeBytewise(field, out);
+    }, iterations);
+    double escapeAfter = nanosPer([&] {
+        out.clear();
+        for (const auto& field : fields) crow::json::escape(field, out);
+    }, iterations);
+    report("escape 120 response fields", escapeBefore, escapeAfter);
+
+    std::string longText(4096, 'a');
+    longText[4000] = '"';
+    double longBefore = nanosPer([&] { out.clear(); escapeBytewise(longText, out); }, iterations / 10);
+    double longAfter = nanosPer([&] { out.clear(); crow::json::escape(longText, out); }, iterations / 10);
+    report("escape 4 KiB string", longBefore, longAfter);
+
+    double bodyBefore = nanosPer([&] { wvalueBody(entities); }, iterations / 10);
+    double bodyAfter = nanosPer([&] { writerBody(entities); }, iterations / 10);
+    report("recommend body (wvalue/JsonWriter)", bodyBefore, bodyAfter);
+    return 0;
+}
@@ -0,0 +1,79 @@
+"""Generates a synthetic fixture for the in-memory storage backend (ROOMMATE_FIXTURE).
+
+Usage: python make_fixture.py OUT.json [--users N] [--rooms N] [--cities N] [--swipes N] [--seed N]
+"""
+import argparse
+import json
+import random
+
+
+def object_id(rng: random.Random, timestamp: int) -> str:
+    return f"{timestamp:08x}{rng.getrandbits(64):016x}"
+
+
+def make_fixture(users: int, rooms: int, cities: int, swipes: int, seed: int) -> dict:
+    rng = random.Random(seed)
+    places = [(f"City{i}", f"State{i % 50}", "USA", f"{10000 + i:05d}") for i in range(cities)]
+    start = 1700000000
+
+    user_docs = []
+    for i in range(users):
+        city, state, country, zipcode = rng.choice(places)
+        user_docs.append({
+            "_id": object_id(rng, start + i),
+            "username": f"user{i}",
+            "firstName": f"First{i}",
+            "lastName": f"Last{i}",
+            "email": f"user{i}@example.com",
+            "phone": f"555-{i:07d}",
+            "gender": rng.choice(["female", "male", "other"]),
+            "address": f"{rng.randint(1, 9999)} Main St",
+            "address_line": "",
+            "city": city, "state": state, "country": country, "zipcode": zipcode,
+            "budget": f"${rng.randint(500, 4000)}",
+            "popularity": 0.0, "matches": 0, "swipesMade": 0, "swipesReceived": 0,
+        })
+
+    room_docs = []
+    for i in range(rooms):
+        city, state, country, zipcode = rng.choice(places)
+        room_docs.append({
+            "_id": object_id(rng, start + users + i),
+            "ownerId": rng.choice(user_docs)["_id"],
+            "address": f"{rng.randint(1, 9999)} Oak Ave",
+            "address_line": f"Unit {rng.randint(1, 40)}",
+            "city": city, "state": state, "country": country, "zipcode": zipcode,
+            "phone": f"555-{i:07d}",
+            "budget": f"${rng.randint(500, 4000)}",
+            "popularity": 0.0,
+        })
+
+    def swipe_docs(targets: list) -> list:
+        by_source = {}
+        for _ in range(swipes):
+            source = rng.choice(user_docs)["_id"]
+            target = rng.choice(targets)["_id"]
+            if target != source:
+                by_source.setdefault(source, set()).add(target)
+        return [{"sourceEntityId": s, "targetEntityId": sorted(t)} for s, t in by_source.items()]
+
+    return {
+        "users": user_docs,
+        "rooms": room_docs,
+        "user_swipes": swipe_docs(user_docs),
+        "room_swipes": swipe_docs(room_docs) if room_docs else [],
+    }
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("out")
+    parser.add_argument("--users", type=int, default=10000)
+    parser.add_argument("--rooms", type=int, default=2000)
+    parser.add_argument("--cities", type=int, default=50)
+    parser.add_argument("--swipes", type=int, default=100000)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    with open(args.out, "w", encoding="utf-8") as f:
+        json.dump(make_fixture(args.users, args.rooms, args.cities, args.swipes, args.seed), f)
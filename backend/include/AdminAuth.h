@@ -0,0 +1,27 @@
+#pragma once
+
+// Access control for the /api/admin/* routes, which expose internals (pool and cache stats,
+// trace captures) and must not be reachable by every client of the public API.
+//
+// With ADMIN_TOKEN set, an admin request must send it as `Authorization: Bearer <token>`.
+// Without it, admin routes only answer clients connecting from a loopback address.
+
+#include <crow/crow_all.h>
+#include <string_view>
+
+/**
+ * Crow middleware answering a request for an admin route 401 or 403 before its handler runs,
+ * unless the request is allowed by the rules above.
+ */
+struct AdminAuthMiddleware {
+    struct context {};
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request&, crow::response&, context&) {}
+};
+
+/// True if the response is this middleware's 401 or 403 for an admin path, matched or not.
+bool isAdminAuthRejection(const crow::request& req, const crow::response& res);
+
+/// True for an IPv4 or IPv6 loopback address, including IPv4-mapped ones such as ::ffff:127.0.0.1.
+bool isLoopbackAddress(std::string_view address);
@@ -0,0 +1,149 @@
+#pragma once
+
+// Coroutine front end for the DB-backed API, built with -DROOMMATE_COROUTINES=ON (C++20).
+// Each call suspends the calling coroutine while the blocking MongoDB work runs on the DB
+// executor and resumes it on its own io_context, so an io thread can keep any number of
+// requests in flight without a thread per blocked call.
+
+#include "BlockingExecutor.h"
+#include "ETag.h"
+#include "Matcher.h"
+#include "RequestTrace.h"
+#include "ResponseCache.h"
+#include <crow/crow_all.h>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/// Raised into the awaiting coroutine when the DB executor's queue is full.
+struct ExecutorSaturated : std::runtime_error {
+    ExecutorSaturated() : std::runtime_error("Server busy, retry later.") {}
+};
+
+/**
+ * Runs `work` on the DB executor and resumes the awaiting coroutine with its result.
+ * Exceptions thrown by `work` are rethrown in the coroutine, and DeadlineExceeded is raised
+ * instead of running `work` if the deadline passed while it was queued.
+ * `work` runs under the request trace current when offload() is awaited (see withRequestTrace()).
+ * @param work Callable to run off the io thread; must be copyable.
+ * @param deadline The request's deadline, applied to the DB work.
+ */
+template <typename Work>
+asio::awaitable<std::invoke_result_t<Work>> offload(Work work, DeadlineClock::time_point deadline = DeadlineClock::time_point::max()) {
+    using Result = std::invoke_result_t<Work>;
+
+    return asio::async_initiate<const asio::use_awaitable_t<>, void(std::exception_ptr, Result)>(
+        [work = std::move(work), deadline](auto handler) mutable {
+            // Resume on the coroutine's own executor, not on the DB worker that finished the work
+            auto executor = asio::get_associated_executor(handler);
+            // The executor queues std::function, which needs a copyable task
+            auto shared_handler = std::make_shared<decltype(handler)>(std::move(handler));
+            auto resume = [executor, shared_handler](std::exception_ptr error, Result result) {
+                asio::post(executor, [shared_handler, error, result = std::move(result)]() mutable {
+                    (*shared_handler)(error, std::move(result));
+                });
+            };
+
+            auto trace = currentRequestTrace();
+            auto queuedAt = std::chrono::steady_clock::now();
+            bool queued = getDbExecutor().trySubmit([work, resume, deadline, trace, queuedAt]() mutable {
+                DeadlineScope deadlineScope(deadline);
+                DbRequestScope dbScope;
+                RequestTraceScope traceScope(trace);
+                if (trace) trace->add(Stage::Queue, std::chrono::steady_clock::now() - queuedAt);
+                if (deadlineScope.expired()) {
+                    return resume(std::make_exception_ptr(DeadlineExceeded{}), Result{});
+                }
+                try {
+                    resume(nullptr, work());
+                } catch (...) {
+                    resume(std::current_exception(), Result{});
+                }
+            });
+            if (!queued) {
+                resume(std::make_exception_ptr(ExecutorSaturated{}), Result{});
+            }
+        },
+        asio::use_awaitable);
+}
+
+/// The response standing in for a handler coroutine that threw.
+inline crow::response handlerErrorResponse(std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const ExecutorSaturated& e) {
+        crow::response res(503, e.what());
+        res.set_header("Retry-After", "1");
+        return res;
+    } catch (const DeadlineExceeded& e) {
+        return crow::response(504, e.what());
+    } catch (const std::exception& e) {
+        return crow::response(500, std::string("Error: ") + e.what());
+    }
+}
+
+/**
+ * Makes `trace` current when a handler coroutine starts, so the offload() it begins with is
+ * attributed to its request. Later legs run after other requests' handlers and are not attributed.
+ */
+inline asio::awaitable<crow::response> withRequestTrace(asio::awaitable<crow::response> handler, std::shared_ptr<RequestTrace> trace) {
+    setCurrentRequestTrace(std::move(trace));
+    co_return co_await std::move(handler);
+}
+
+/**
+ * Runs a handler coroutine on the request's io_context and completes `res` with its result.
+ * Unlike dispatchBlocking(), the response is compressed on the io thread once the coroutine returns.
+ * @param req The request being handled.
+ * @param res The response to complete.
+ * @param handler The coroutine producing the response.
+ * @param compression How the endpoint's responses are compressed.
+ */
+inline void spawnHandler(const crow::request& req, crow::response& res, asio::awaitable<crow::response> handler,
+                         const CompressionPolicy& compression = {}) {
+    auto encoding = compression.level > 0 ? negotiateEncoding(req.get_header_value("Accept-Encoding")) : ContentEncoding::Identity;
+    asio::co_spawn(*req.io_context, withRequestTrace(std::move(handler), currentRequestTrace()), [&res, compression, encoding](std::exception_ptr error, crow::response result) {
+        if (error) {
+            res = handlerErrorResponse(error);
+            return res.end();
+        }
+        res = std::move(result);
+        compressResponse(res, encoding, compression);
+        res.end();
+    });
+}
+
+/**
+ * spawnHandler() in front of the response cache (see dispatchCached()). The response is handed
+ * to ResponseCache::complete() on the DB executor, which compresses it, unless the queue is full.
+ * @param key The request's cache key, built with responseCacheKey().
+ * @param ttl How long the response stays cached; 0 to only coalesce.
+ */
+inline void spawnCached(const crow::request& req, crow::response& res, const std::string& key, std::chrono::milliseconds ttl,
+                        asio::awaitable<crow::response> handler, const CompressionPolicy& compression) {
+    if (serveCachedOrQueue(req, res, key, compression)) return;
+
+    asio::co_spawn(*req.io_context, withRequestTrace(std::move(handler), currentRequestTrace()), [key, ttl, compression](std::exception_ptr error, crow::response result) {
+        auto response = std::make_shared<crow::response>(error ? handlerErrorResponse(error) : std::move(result));
+        auto finish = [key, ttl, compression, response] {
+            getResponseCache().complete(key, std::move(*response), ttl, compression);
+        };
+        if (!getDbExecutor().trySubmit(finish)) finish();
+    });
+}
+
+/// Tags the response of a handler coroutine with `etag` (see ETag.h); a thrown error propagates untagged.
+inline asio::awaitable<crow::response> withETag(asio::awaitable<crow::response> handler, std::string etag) {
+    auto res = co_await std::move(handler);
+    setETag(res, etag);
+    co_return res;
+}
+
+asio::awaitable<crow::response> asyncGetRecommendations(std::string currentUserId, std::string type);
+asio::awaitable<crow::response> asyncGetUserWhoLikedEntity(std::string entityId, std::string type, std::string cursor, size_t limit);
+asio::awaitable<crow::response> asyncProcessSwipe(std::string sourceId, std::string targetId, std::string type, bool isLike);
+asio::awaitable<crow::response> asyncProcessSwipes(std::vector<SwipeItem> swipes);
+asio::awaitable<crow::response> asyncRankUsers(std::string targetId, std::string type);
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Compression.h"
+#include "DbMetrics.h"
+#include "Deadline.h"
+#include "RequestTrace.h"
+#include <crow/crow_all.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Bounded thread pool for blocking work (MongoDB round trips) so it never runs on Crow's
+ * io_context threads. When the queue is full new work is rejected instead of queued,
+ * which lets handlers shed load with a 503 rather than grow latency without bound.
+ */
+class BlockingExecutor {
+public:
+    BlockingExecutor(size_t threads, size_t maxQueueDepth);
+    ~BlockingExecutor();
+
+    /// Queues a task. Returns false if the queue is full or the executor is stopping.
+    bool trySubmit(std::function<void()> task);
+    /// Runs the queued tasks to completion and joins the workers.
+    void stop();
+
+    size_t threadCount() const { return workers_.size(); }
+    /// Workers not currently running a task.
+    size_t idleThreads() const { return workers_.size() - busy_.load(); }
+    size_t maxQueueDepth() const { return maxQueueDepth_; }
+    size_t queueDepth() const;
+    int64_t rejected() const { return rejected_.load(); }
+
+private:
+    void run();
+
+    size_t maxQueueDepth_;
+    mutable std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    std::atomic<int64_t> rejected_{0};
+    std::atomic<size_t> busy_{0};
+    std::vector<std::thread> workers_;
+};
+
+BlockingExecutor& getDbExecutor();
+
+/// The response to a request turned away because the DB executor's queue is full.
+inline crow::response executorBusyResponse() {
+    crow::response res(503, "Server busy, retry later.");
+    res.set_header("Retry-After", "1");
+    return res;
+}
+
+/**
+ * Runs `work` on the DB executor under the request's deadline, DB metrics and trace scopes, then hands
+ * the response to `done` on the same worker: the one `work` returned, a 504 if it ran past its
+ * deadline, a 500 if it threw anything else, or a 504 without running it when the budget was
+ * spent waiting in the queue.
+ * @param budget The request's deadline budget, counted from now; 0 for none.
+ * @param work Callable returning a crow::response.
+ * @param done Callable taking the crow::response.
+ * @return False, without running either callable, when the executor is saturated.
+ */
+template <typename Work, typename Done>
+bool submitRequest(std::chrono::milliseconds budget, Work work, Done done) {
+    auto deadline = deadlineAfter(budget);
+    auto trace = currentRequestTrace();
+    auto queuedAt = std::chrono::steady_clock::now();
+    return getDbExecutor().trySubmit([deadline, trace, queuedAt, work = std::move(work), done = std::move(done)]() mutable {
+        crow::response result;
+        {
+            DeadlineScope deadlineScope(deadline);
+            DbRequestScope dbScope;
+            RequestTraceScope traceScope(trace);
+            if (trace) trace->add(Stage::Queue, std::chrono::steady_clock::now() - queuedAt);
+            if (deadlineScope.expired()) {
+                result = crow::response(504, "Deadline exceeded while queued.");
+            } else {
+                try {
+                    result = work();
+                } catch (const DeadlineExceeded& e) {
+                    result = crow::response(504, e.what());
+                } catch (const std::exception& e) {
+                    result = crow::response(500, std::string("Error: ") + e.what());
+                }
+            }
+            dbScope.annotate(result);
+        }
+        done(std::move(result));
+    });
+}
+
+/**
+ * Adapts a stream for crow::response::set_chunked_body(): each `stream->next(chunk)` runs on the
+ * DB executor under its own deadline of `budget` and the request's trace, and the connection asks
+ * for the next chunk only once it has written the previous one, so a slow client holds no worker.
+ * When the executor is saturated or a chunk's budget is spent in the queue, `stream->fail(chunk, error)`
+ * ends the body instead.
+ * @param budget The deadline budget of each chunk; 0 for none.
+ * @param stream Has `bool next(std::string&)` and `void fail(std::string&, const std::string&)`.
+ */
+template <typename Stream>
+crow::response::chunk_producer offloadChunks(std::chrono::milliseconds budget, std::shared_ptr<Stream> stream) {
+    auto trace = currentRequestTrace();
+    return [budget, trace, stream](std::function<void(std::string, bool)> next) {
+        auto deadline = deadlineAfter(budget);
+        bool queued = getDbExecutor().trySubmit([deadline, trace, stream, next] {
+            std::string chunk;
+            bool more = false;
+            {
+                DeadlineScope deadlineScope(deadline);
+                RequestTraceScope traceScope(trace);
+                if (deadlineScope.expired()) {
+                    stream->fail(chunk, "Deadline exceeded while queued.");
+                } else {
+                    more = stream->next(chunk);
+                }
+            }
+            next(std::move(chunk), more);
+        });
+
+        if (!queued) {
+            std::string chunk;
+            stream->fail(chunk, "Server busy, retry later.");
+            next(std::move(chunk), false);
+        }
+    };
+}
+
+/**
+ * Runs `work` on the DB executor and completes `res` with the response it returns, back on
+ * the io_context thread that owns the connection. Responds 503 when the executor is saturated,
+ * and 504 without running `work` when the budget was spent waiting in the queue.
+ * The response is compressed on the DB worker as well, so the io thread only writes it.
+ * `work` runs after the handler returns, so it must capture request data by value.
+ * @param req The request being handled.
+ * @param res The response to complete.
+ * @param budget The request's deadline budget, counted from now; 0 for none.
+ * @param compression How the endpoint's responses are compressed.
+ * @param work Callable returning a crow::response.
+ */
+template <typename Work>
+void dispatchBlocking(const crow::request& req, crow::response& res, std::chrono::milliseconds budget,
+                      const CompressionPolicy& compression, Work work) {
+    asio::io_context* io_context = req.io_context;
+    auto encoding = compression.level > 0 ? negotiateEncoding(req.get_header_value("Accept-Encoding")) : ContentEncoding::Identity;
+    bool queued = submitRequest(budget, std::move(work), [io_context, &res, compression, encoding](crow::response result) {
+        compressResponse(result, encoding, compression);
+        asio::post(*io_context, [&res, result = std::move(result)]() mutable {
+            res = std::move(result);
+            res.end();
+        });
+    });
+
+    if (!queued) {
+        res = executorBusyResponse();
+        res.end();
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+// Single-pass decoding of BSON documents into plain structs.
+//
+// A struct opts in by specializing BsonFields<T> with a constexpr table mapping BSON keys to
+// its members. decodeBson<T>() then walks the document once and assigns each element to the
+// member whose key matches, instead of doing one linear doc["key"] scan per field.
+//
+// std::string_view members point into the document's buffer and are only valid while the
+// document they were decoded from is alive; use std::string members when the value must
+// outlive it.
+
+#include <bsoncxx/document/element.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/oid.hpp>
+#include <bsoncxx/types.hpp>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+template <typename T, typename Member>
+struct BsonField {
+    std::string_view key;
+    Member T::*member;
+};
+
+template <typename T, typename Member>
+constexpr BsonField<T, Member> bsonField(std::string_view key, Member T::*member) {
+    return {key, member};
+}
+
+/// Specialize with `static constexpr auto fields = std::make_tuple(bsonField(...), ...);`
+template <typename T>
+struct BsonFields;
+
+namespace bson_decode {
+
+inline std::string_view stringView(const bsoncxx::document::element& element) {
+    auto value = element.get_string().value;
+    return {value.data(), value.size()};
+}
+
+// ObjectIds decode to their hex form so owned records can hold ids as plain strings
+inline void assign(std::string& out, const bsoncxx::document::element& element) {
+    if (element.type() == bsoncxx::type::k_string) out = std::string(stringView(element));
+    else if (element.type() == bsoncxx::type::k_oid) out = element.get_oid().value.to_string();
+}
+
+inline void assign(std::string_view& out, const bsoncxx::document::element& element) {
+    if (element.type() == bsoncxx::type::k_string) out = stringView(element);
+}
+
+inline void assign(double& out, const bsoncxx::document::element& element) {
+    switch (element.type()) {
+        case bsoncxx::type::k_double: out = element.get_double().value; break;
+        case bsoncxx::type::k_int32: out = element.get_int32().value; break;
+        case bsoncxx::type::k_int64: out = static_cast<double>(element.get_int64().value); break;
+        default: break;
+    }
+}
+
+inline void assign(int& out, const bsoncxx::document::element& element) {
+    switch (element.type()) {
+        case bsoncxx::type::k_int32: out = element.get_int32().value; break;
+        case bsoncxx::type::k_int64: out = static_cast<int>(element.get_int64().value); break;
+        case bsoncxx::type::k_double: out = static_cast<int>(element.get_double().value); break;
+        default: break;
+    }
+}
+
+inline void assign(std::optional<double>& out, const bsoncxx::document::element& element) {
+    switch (element.type()) {
+        case bsoncxx::type::k_double:
+        case bsoncxx::type::k_int32:
+        case bsoncxx::type::k_int64: assign(out.emplace(), element); break;
+        default: break;
+    }
+}
+
+// std::optional because a default-constructed bsoncxx::oid generates a fresh ObjectId
+inline void assign(std::optional<bsoncxx::oid>& out, const bsoncxx::document::element& element) {
+    if (element.type() == bsoncxx::type::k_oid) out = element.get_oid().value;
+}
+
+} // namespace bson_decode
+
+/**
+ * Decodes `doc` into a T in one pass over its elements.
+ * Missing keys and elements of an unexpected type leave the member at its default.
+ */
+template <typename T>
+T decodeBson(bsoncxx::document::view doc) {
+    T out{};
+    for (auto&& element : doc) {
+        auto raw_key = element.key();
+        std::string_view key(raw_key.data(), raw_key.size());
+        std::apply([&](const auto&... fields) {
+            // Stops at the first matching field
+            (void)((fields.key == key ? (bson_decode::assign(out.*(fields.member), element), true) : false) || ...);
+        }, BsonFields<T>::fields);
+    }
+    return out;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// Allocation-free BSON for the small, fixed-shape filters on hot paths.
+//
+// The stream builder allocates a bson_t and a frame stack per document and copies the result
+// into a document::value, several heap allocations for a filter like {_id: <oid>}. BsonFilter
+// encodes its elements straight into an inline buffer instead; only filters larger than the
+// buffer (long city names, say) fall back to the heap.
+
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/oid.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+class BsonFilter {
+public:
+    BsonFilter() = default;
+    BsonFilter(const BsonFilter&) = delete;
+    BsonFilter& operator=(const BsonFilter&) = delete;
+
+    /// Appends `key: ObjectId(value)`. Keys must not contain NUL bytes.
+    BsonFilter& append(std::string_view key, const bsoncxx::oid& value) {
+        writeHeader(0x07, key);
+        write(value.bytes(), bsoncxx::oid::k_oid_length);
+        return *this;
+    }
+
+    /// Appends `key: "value"`.
+    BsonFilter& append(std::string_view key, std::string_view value) {
+        writeHeader(0x02, key);
+        writeInt32(static_cast<int32_t>(value.size() + 1));
+        write(value.data(), value.size());
+        writeByte(0);
+        return *this;
+    }
+
+    /// Terminates the document; it must not be appended to afterwards.
+    bsoncxx::document::view view() {
+        if (!finished_) {
+            writeByte(0);
+            storeInt32(data(), static_cast<int32_t>(size_));
+            finished_ = true;
+        }
+        return bsoncxx::document::view(data(), size_);
+    }
+
+private:
+    static constexpr size_t kInlineSize = 128;
+
+    uint8_t* data() { return heap_.empty() ? inline_.data() : heap_.data(); }
+
+    void reserve(size_t extra) {
+        size_t needed = size_ + extra;
+        if (heap_.empty()) {
+            if (needed <= kInlineSize) return;
+            heap_.assign(inline_.begin(), inline_.begin() + size_);
+        }
+        if (needed > heap_.size()) heap_.resize(std::max(needed, heap_.size() * 2));
+    }
+
+    void write(const void* bytes, size_t length) {
+        reserve(length);
+        std::memcpy(data() + size_, bytes, length);
+        size_ += length;
+    }
+
+    void writeByte(uint8_t byte) { write(&byte, 1); }
+
+    // BSON integers are little-endian regardless of the host
+    static void storeInt32(uint8_t* at, int32_t value) {
+        at[0] = static_cast<uint8_t>(value);
+        at[1] = static_cast<uint8_t>(value >> 8);
+        at[2] = static_cast<uint8_t>(value >> 16);
+        at[3] = static_cast<uint8_t>(value >> 24);
+    }
+
+    void writeInt32(int32_t value) {
+        reserve(4);
+        storeInt32(data() + size_, value);
+        size_ += 4;
+    }
+
+    void writeHeader(uint8_t type, std::string_view key) {
+        writeByte(type);
+        write(key.data(), key.size());
+        writeByte(0);
+    }
+
+    std::array<uint8_t, kInlineSize> inline_;
+    std::vector<uint8_t> heap_;
+    size_t size_ = 4;  // Starts past the length prefix, which view() fills in
+    bool finished_ = false;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+// HTTP response compression. The encoding is negotiated from the request's Accept-Encoding
+// and the body is compressed with zlib on the thread that produced it, so io threads only
+// write the result. Each DB-backed endpoint has its own policy: list endpoints compress well,
+// while swipe acknowledgements are below any useful threshold.
+
+#include <crow/crow_all.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class ContentEncoding { Identity, Gzip, Deflate };
+
+/**
+ * How an endpoint's responses are compressed.
+ * A level of 0 turns compression off for the endpoint.
+ */
+struct CompressionPolicy {
+    int level = 0;         // zlib level, 1 (fastest) to 9 (smallest)
+    size_t minBytes = 0;   // Bodies shorter than this are sent as they are
+};
+
+/**
+ * Compression policy of each DB-backed endpoint. The levels can be overridden with
+ * COMPRESSION_RECOMMEND_LEVEL, COMPRESSION_LIKES_LEVEL, COMPRESSION_SWIPE_LEVEL,
+ * COMPRESSION_SWIPES_LEVEL and COMPRESSION_RANK_LEVEL, and the shared threshold with
+ * COMPRESSION_MIN_BYTES (default 1024).
+ */
+struct CompressionPolicies {
+    CompressionPolicy recommend;
+    CompressionPolicy likes;
+    CompressionPolicy swipe;
+    CompressionPolicy swipes;
+    CompressionPolicy rank;
+};
+
+const CompressionPolicies& getCompressionPolicies();
+
+/**
+ * Picks the encoding for a response from the request's Accept-Encoding header, honouring
+ * q-values and "*". gzip wins ties with deflate.
+ * @param acceptEncoding The header value; empty when the client sent none.
+ */
+ContentEncoding negotiateEncoding(std::string_view acceptEncoding);
+
+/// The Content-Encoding token of an encoding, or an empty string for identity.
+const char* contentEncodingName(ContentEncoding encoding);
+
+/**
+ * Compresses `body` as a complete gzip or zlib (HTTP "deflate") stream.
+ * @return The compressed bytes, or an empty string on a zlib error or for identity.
+ */
+std::string compressBody(std::string_view body, ContentEncoding encoding, int level);
+
+/**
+ * Compresses a finished response in place when the policy allows it, the client accepts an
+ * encoding and the body is long enough and actually shrinks. Responses of a compressing
+ * endpoint always get `Vary: Accept-Encoding` so caches keep the variants apart.
+ */
+void compressResponse(crow::response& res, ContentEncoding encoding, const CompressionPolicy& policy);
+
+/// Bytes before and after compression, for /api/admin/compression.
+crow::json::wvalue getCompressionStats();
@@ -1,23 +1,110 @@
 #pragma once
 
-#include "Profile.h"
+#include <crow/crow_all.h>
 #include <mongocxx/client.hpp>
 #include <mongocxx/database.hpp>
 #include <mongocxx/collection.hpp>
+#include <mongocxx/pool.hpp>
+#include <atomic>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <vector>
+
+/// Sizing of the MongoDB client pool.
+struct PoolOptions {
+    int minPoolSize = 0;
+    int maxPoolSize = 100;
+    int waitQueueTimeoutMS = 2000;
+
+    /// Reads MONGODB_POOL_MIN, MONGODB_POOL_MAX and MONGODB_POOL_WAIT_MS, keeping the defaults for unset variables.
+    static PoolOptions fromEnv();
+};
+
+/// Snapshot of the client pool's occupancy.
+struct PoolStats {
+    int maxPoolSize;
+    int64_t inUse;
+    int64_t peakInUse;
+    int64_t acquired;
+    int64_t timeouts;
+    double avgWaitMs;
+};
+
+class DBManager;
+
+/**
+ * RAII lease of a pooled client, returned to the pool on destruction.
+ * Collections obtained from a lease use its client, so the lease must outlive them.
+ * Each collection handle is created on its first use and reused for the rest of the lease.
+ * Handles cannot be kept across leases: the pool wraps its client in a new object on every
+ * acquire, and a handle is bound to that object.
+ */
+class ClientLease {
+public:
+    ClientLease(ClientLease&& other) noexcept;
+    ClientLease& operator=(ClientLease&&) = delete;
+    ClientLease(const ClientLease&) = delete;
+    ~ClientLease();
+
+    mongocxx::collection& getUserCollection() { return collection(users_, "users"); }
+    mongocxx::collection& getRoomCollection() { return collection(rooms_, "rooms"); }
+    mongocxx::collection& getUserSwipeCollection() { return collection(userSwipes_, "user_swipes"); }
+    mongocxx::collection& getRoomSwipeCollection() { return collection(roomSwipes_, "room_swipes"); }
+    mongocxx::collection& getUserLikesInboxCollection() { return collection(userLikesInbox_, "user_likes_inbox"); }
+    mongocxx::collection& getRoomLikesInboxCollection() { return collection(roomLikesInbox_, "room_likes_inbox"); }
+    mongocxx::database& getDatabase();
+
+private:
+    friend class DBManager;
+    ClientLease(DBManager* manager, mongocxx::pool::entry entry);
+
+    mongocxx::collection& collection(std::optional<mongocxx::collection>& handle, const char* name);
+
+    DBManager* manager_;
+    mongocxx::pool::entry entry_;
+    // Handles bound to entry_'s client; a lease is used by one thread at a time
+    std::optional<mongocxx::database> db_;
+    std::optional<mongocxx::collection> users_, rooms_, userSwipes_, roomSwipes_, userLikesInbox_, roomLikesInbox_;
+};
 
 class DBManager {
 public:
-    DBManager(const std::string& mongo_uri);
-    mongocxx::collection getUserCollection();
-    mongocxx::collection getRoomCollection();
-    mongocxx::collection getUserSwipeCollection();
-    mongocxx::collection getRoomSwipeCollection();
+    DBManager(const std::string& mongo_uri, const PoolOptions& options = PoolOptions::fromEnv());
+
+    /// Leases a client, waiting at most waitQueueTimeoutMS. Throws std::runtime_error when the pool is exhausted.
+    ClientLease acquire();
+    PoolStats poolStats() const;
+
+    /**
+     * Creates the indexes the hot queries rely on: (country, city) on users and rooms,
+     * ownerId on rooms, sourceEntityId and (targetEntityId, _id) on the swipe collections,
+     * and (entityId, _id) and unique (entityId, likers.id) on the liked-by inboxes. Indexes that
+     * already exist are left as they are, so this is safe to run on every boot. Errors the
+     * server reports for an index are logged, not thrown.
+     * @throws mongocxx::exception at the first error that is not the server's, such as no
+     *         server being reachable, without trying the remaining indexes.
+     */
+    void ensureIndexes();
+
+    /**
+     * Explains each hot query shape without running it.
+     * @return A description of every shape whose winning plan is a collection scan.
+     * @throws mongocxx::exception if a query cannot be explained.
+     */
+    std::vector<std::string> findCollectionScans();
 private:
-    mongocxx::client client_;
-    mongocxx::database db;
+    friend class ClientLease;
+
+    PoolOptions options_;
+    mongocxx::pool pool_;
+
+    std::atomic<int64_t> inUse_{0};
+    std::atomic<int64_t> peakInUse_{0};
+    std::atomic<int64_t> acquired_{0};
+    std::atomic<int64_t> timeouts_{0};
+    std::atomic<int64_t> waitNanos_{0};
 };
 
 DBManager& getDbManager();
-crow::json::wvalue fetchUserInfo(const std::string& userId);
-crow::json::wvalue (const std::string& userId)
\ No newline at end of file
+crow::json::wvalue getDbPoolStats();
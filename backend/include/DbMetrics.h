@@ -0,0 +1,80 @@
+#pragma once
+
+#include <crow/crow_all.h>
+#include <mongocxx/options/apm.hpp>
+#include <cstdint>
+#include <string>
+
+/**
+ * Command monitoring (APM) listeners for the MongoDB pool. They record a latency histogram
+ * per command name and collection, count the round trips made on behalf of each HTTP request,
+ * and log commands slower than DB_SLOW_QUERY_MS (default 100, 0 disables) with their filter shape.
+ */
+mongocxx::options::apm makeDbApmOptions();
+
+/// Command latency histograms and round trips per request, for /api/admin/dbmetrics.
+crow::json::wvalue getDbMetrics();
+
+/// Appends the command latency histograms and round trips per request in the Prometheus text format.
+void appendDbPrometheusMetrics(std::string& out);
+
+/**
+ * Estimates a command's latency percentile from its histogram, as the upper bound of the
+ * bucket the percentile falls in.
+ * @param command The command name, e.g. "find".
+ * @param collection The collection it ran against.
+ * @param percentile Between 0 and 1.
+ * @return The estimate in microseconds, or 0 until the command has enough samples.
+ */
+int64_t commandLatencyPercentileMicros(const std::string& command, const std::string& collection, double percentile);
+
+/// Counts a read that was hedged with a second attempt.
+void countHedgedRead();
+
+/**
+ * Attributes the MongoDB commands run on this thread to one HTTP request while in scope.
+ * Command events fire on the thread that issued the command, so the scope must be opened
+ * on the thread running the request's DB work.
+ */
+class DbRequestScope {
+public:
+    DbRequestScope();
+    ~DbRequestScope();
+    DbRequestScope(const DbRequestScope&) = delete;
+    DbRequestScope& operator=(const DbRequestScope&) = delete;
+
+    int roundTrips() const;
+    double dbMillis() const;
+
+    /// Adds a Server-Timing header with the time spent in MongoDB, if any command ran.
+    void annotate(crow::response& res) const;
+
+private:
+    int savedRoundTrips_;
+    int64_t savedMicros_;
+    bool savedActive_;
+};
+
+/**
+ * Collects the MongoDB commands run on this thread while in scope, for work done on another
+ * thread on behalf of a request, such as an attempt of a hedged read. Unlike DbRequestScope it
+ * does not count as a request; the request's thread adds its totals with addToDbRequest().
+ */
+class DbWorkScope {
+public:
+    DbWorkScope();
+    ~DbWorkScope();
+    DbWorkScope(const DbWorkScope&) = delete;
+    DbWorkScope& operator=(const DbWorkScope&) = delete;
+
+    int roundTrips() const;
+    int64_t micros() const;
+
+private:
+    int savedRoundTrips_;
+    int64_t savedMicros_;
+    bool savedActive_;
+};
+
+/// Adds commands run on another thread to the DbRequestScope open on this thread, if any.
+void addToDbRequest(int roundTrips, int64_t micros);
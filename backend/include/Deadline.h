@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+
+// Per-request deadlines. A handler's budget starts when the request is dispatched, so time
+// spent queued for the DB executor counts against it, and every MongoDB read and update made
+// on its behalf carries the remaining budget as maxTimeMS.
+
+using DeadlineClock = std::chrono::steady_clock;
+
+/// Thrown when a request's deadline passes before its DB work is issued.
+struct DeadlineExceeded : std::runtime_error {
+    DeadlineExceeded() : std::runtime_error("Deadline exceeded.") {}
+};
+
+/**
+ * Time budget of each DB-backed endpoint, overridable with DEADLINE_RECOMMEND_MS,
+ * DEADLINE_LIKES_MS, DEADLINE_SWIPE_MS, DEADLINE_SWIPES_MS and DEADLINE_RANK_MS. A budget of 0 disables the deadline.
+ */
+struct EndpointBudgets {
+    std::chrono::milliseconds recommend;
+    std::chrono::milliseconds likes;
+    std::chrono::milliseconds swipe;
+    std::chrono::milliseconds swipes;
+    std::chrono::milliseconds rank;
+};
+
+const EndpointBudgets& getEndpointBudgets();
+
+/// The deadline `budget` from now, or time_point::max() (no deadline) for a zero budget.
+DeadlineClock::time_point deadlineAfter(std::chrono::milliseconds budget);
+
+/**
+ * Makes `deadline` the current thread's deadline while in scope. Nested scopes can only
+ * shorten it.
+ */
+class DeadlineScope {
+public:
+    explicit DeadlineScope(DeadlineClock::time_point deadline);
+    ~DeadlineScope();
+    DeadlineScope(const DeadlineScope&) = delete;
+    DeadlineScope& operator=(const DeadlineScope&) = delete;
+
+    bool expired() const;
+
+private:
+    DeadlineClock::time_point saved_;
+};
+
+/// The current thread's deadline, or time_point::max() when none is set.
+DeadlineClock::time_point currentDeadline();
+
+/**
+ * Time left before the current thread's deadline, rounded up to whole milliseconds.
+ * @return The remaining budget, or std::nullopt when no deadline is set.
+ * @throws DeadlineExceeded if the deadline has already passed.
+ */
+std::optional<std::chrono::milliseconds> remainingBudget();
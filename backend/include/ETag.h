@@ -0,0 +1,59 @@
+#pragma once
+
+// Conditional GETs for the polled read endpoints. Writers bump in-process version counters
+// for the data a response depends on, and handlers derive a weak ETag from them before doing
+// any DB work, so a poll whose data has not changed is answered 304 from the io thread.
+// Versions are as narrow as the data: likes per entity, recommendations per kind and city,
+// so a swipe in one city does not retag every other city's recommendations.
+//
+// A tag also carries a random id of this process, so a tag issued by another replica or an
+// earlier run never matches, and the current ETAG_MAX_AGE_S window (default 60, 0 disables
+// ETags), which bounds how long writes made outside the server, such as the
+// recompute_popularity job, can go unnoticed.
+
+#include "Storage.h"
+#include <crow/crow_all.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// Marks the recommendations of `kind` in a city as changed, e.g. after popularity deltas of entities there were applied.
+void bumpRankingVersion(EntityKind kind, const std::string& country, const std::string& city);
+
+/// Notes the city a user is recommended entities of, so their later requests can be tagged before any DB work.
+void rememberUserCity(const std::string& userId, const std::string& country, const std::string& city);
+
+/// Marks the likers of an entity as changed.
+void bumpLikesVersion(EntityKind kind, const std::string& entityId);
+
+/**
+ * The current ranking version of `kind` in the user's city; it changes whenever
+ * bumpRankingVersion() is called for that city.
+ * @return The version, or std::nullopt if rememberUserCity() has not been called for the user.
+ */
+std::optional<uint64_t> rankingVersion(EntityKind kind, const std::string& userId);
+
+/// The current likes version of an entity; it changes whenever bumpLikesVersion() is called for it.
+uint64_t likesVersion(EntityKind kind, const std::string& entityId);
+
+/// The ETag of /api/recommend for entities of `kind` at a rankingVersion(), or an empty string when ETags are disabled.
+std::string recommendationsETag(EntityKind kind, uint64_t version);
+
+/// The ETag of an /api/likes page of the entity, or an empty string when ETags are disabled.
+std::string likesETag(EntityKind kind, const std::string& entityId);
+
+/**
+ * True if an If-None-Match header matches `etag` under the weak comparison of RFC 9110:
+ * "*", or any listed tag equal to it once W/ prefixes are ignored.
+ */
+bool etagMatches(std::string_view ifNoneMatch, std::string_view etag);
+
+/**
+ * Ends `res` with 304 Not Modified if the request's If-None-Match matches `etag`.
+ * @return True if the response was sent and the handler has nothing left to do.
+ */
+bool answerNotModified(const crow::request& req, crow::response& res, const std::string& etag);
+
+/// Tags a response with `etag` and asks clients to revalidate it on every use. Errors are left untagged.
+void setETag(crow::response& res, const std::string& etag);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Storage.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Sharded LRU cache of entity cards already serialized to JSON, so a recommendation response is
+ * assembled by copying fragments instead of decoding and re-serializing each entity.
+ *
+ * Writers call invalidate() after changing an entity. A reader that misses takes version()
+ * before reading storage and passes it to put(); the card is only cached if no invalidation
+ * hit the shard in between, so a read racing a write can never cache the old card.
+ *
+ * Each card also keeps the stored popularity it was built from. Readers already have the current
+ * value from the ranking scan and treat a card with a different one as a miss, which catches
+ * writes made outside this process, such as the recompute_popularity job. Other fields edited
+ * outside this process are caught by the TTL: a card expires a fixed time after it was cached.
+ */
+class EntityCardCache {
+public:
+    struct Card {
+        std::string json;
+        double popularity;
+        std::chrono::steady_clock::time_point expiresAt;
+    };
+    using Fragment = std::shared_ptr<const Card>;
+
+    /**
+     * @param capacity Total number of cards kept; 0 disables caching.
+     * @param ttl How long a card is served after it was cached; 0 keeps cards until evicted.
+     * @param shardCount Number of independently locked shards.
+     */
+    EntityCardCache(size_t capacity, std::chrono::seconds ttl, size_t shardCount = 16);
+
+    /// The cached card, or nullptr on a miss or once it has expired.
+    Fragment get(EntityKind kind, const std::string& id);
+    /// The version to pass to put() for a card about to be read from storage.
+    uint64_t version(EntityKind kind, const std::string& id);
+    /**
+     * Caches a card serialized from data read after version() returned `version`.
+     * @return The card, whether or not it was cached.
+     */
+    Fragment put(EntityKind kind, const std::string& id, uint64_t version, std::string json, double popularity);
+    /// Drops an entity's card; call after every write to the entity.
+    void invalidate(EntityKind kind, const std::string& id);
+
+    int64_t hits() const { return hits_.load(); }
+    int64_t misses() const { return misses_.load(); }
+    size_t size();
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        // Most recently used first
+        std::list<std::pair<std::string, Fragment>> lru;
+        std::unordered_map<std::string, std::list<std::pair<std::string, Fragment>>::iterator> index;
+        uint64_t version = 0;
+    };
+
+    static std::string key(EntityKind kind, const std::string& id);
+    Shard& shardFor(const std::string& key);
+
+    size_t shardCapacity_;
+    std::chrono::seconds ttl_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<int64_t> hits_{0};
+    std::atomic<int64_t> misses_{0};
+};
+
+/**
+ * The process-wide card cache, sized by ENTITY_CARD_CACHE_SIZE (default 50000, 0 disables), with
+ * cards expiring after ENTITY_CARD_TTL_SECONDS (default 300, 0 never).
+ */
+EntityCardCache& getEntityCardCache();
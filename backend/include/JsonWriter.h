@@ -0,0 +1,120 @@
+#pragma once
+
+// Streaming JSON writer for API responses.
+//
+// crow::json::wvalue builds a tree first (a map per object, a string copy per field) and then
+// walks it again to serialize. JsonWriter appends straight into one pre-reserved string instead,
+// so a response costs a single buffer and a single pass. It does not validate structure: callers
+// pair begin/end calls and put a key() before every value inside an object.
+
+#include <crow/crow_all.h>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+class JsonWriter {
+public:
+    /// Writes into a string owned by the writer, reserved up front.
+    explicit JsonWriter(size_t reserve = 1024) : out_(own_) { out_.reserve(reserve); }
+    /// Appends to `out`, e.g. one chunk of a chunked response.
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator=(const JsonWriter&) = delete;
+
+    JsonWriter& beginObject() { separate(); out_ += '{'; first_ = true; return *this; }
+    JsonWriter& endObject() { out_ += '}'; first_ = false; return *this; }
+    JsonWriter& beginArray() { separate(); out_ += '['; first_ = true; return *this; }
+    JsonWriter& endArray() { out_ += ']'; first_ = false; return *this; }
+
+    JsonWriter& key(std::string_view name) {
+        separate();
+        writeString(name);
+        out_ += ':';
+        first_ = true;  // The value that follows takes no comma
+        return *this;
+    }
+
+    JsonWriter& value(std::string_view text) { separate(); writeString(text); return *this; }
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+    JsonWriter& value(const std::string& text) { return value(std::string_view(text)); }
+    JsonWriter& value(bool flag) { separate(); out_ += flag ? "true" : "false"; return *this; }
+    JsonWriter& null() { separate(); out_ += "null"; return *this; }
+    /// Appends a value that is already serialized JSON, e.g. a cached fragment.
+    JsonWriter& raw(std::string_view json) { separate(); out_ += json; return *this; }
+
+    /// Doubles are written in their shortest round-trip form; NaN and infinities as null, like crow.
+    JsonWriter& value(double number) {
+        if (!std::isfinite(number)) return null();
+        separate();
+        char buffer[32];
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer), number).ptr;
+        out_.append(buffer, end);
+        return *this;
+    }
+
+    template <typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+    JsonWriter& value(T number) {
+        separate();
+        char buffer[24];
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer), number).ptr;
+        out_.append(buffer, end);
+        return *this;
+    }
+
+    /// Shorthand for key(name).value(v).
+    template <typename T>
+    JsonWriter& field(std::string_view name, const T& v) { key(name); return value(v); }
+
+    /// The JSON written so far.
+    const std::string& str() const { return out_; }
+    /// Moves the JSON out of a writer that owns its string.
+    std::string release() { return std::move(out_); }
+
+private:
+    void separate() {
+        if (!first_) out_ += ',';
+        first_ = false;
+    }
+
+    void writeString(std::string_view text) {
+        out_ += '"';
+        crow::json::escape(text.data(), text.size(), out_);
+        out_ += '"';
+    }
+
+    std::string own_;
+    std::string& out_;
+    bool first_ = true;
+};
+
+/**
+ * A 200 response carrying JSON produced by a JsonWriter.
+ * @param body The serialized JSON.
+ */
+inline crow::response jsonResponse(std::string body) {
+    crow::response res(std::move(body));
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
+
+/// A `{"error": message}` body, the shape every API function reports failures in.
+inline std::string jsonError(std::string_view message) {
+    JsonWriter writer(64 + message.size());
+    writer.beginObject().field("error", message).endObject();
+    return writer.release();
+}
+
+/**
+ * jsonResponse() for the body of a polled read, sent as 400 if it is a jsonError(): those
+ * report bad input, while storage failures are thrown and become a 500 or 504.
+ */
+inline crow::response jsonReadResponse(std::string body) {
+    bool error = body.compare(0, 9, "{\"error\":") == 0;
+    auto res = jsonResponse(std::move(body));
+    if (error) res.code = 400;
+    return res;
+}
@@ -1,9 +1,11 @@
 #pragma once
 
-#include <mongocxx/collection.hpp>
-#include <bsoncxx/oid.hpp>
+#include "Storage.h"
 #include <crow/crow_all.h>
+#include <functional>
+#include <optional>
 #include <string>
+#include <vector>
 
 // These function aren't needed in the header as they are only used in the .cpp. They will be declared as static functions in the .cpp file.
 // They are not part of the public API and should not be exposed in the header file.
@@ -26,6 +28,43 @@
 
 // bool swipeExists(mongocxx::collection& swipe_collection, const bsoncxx::oid& sourceEntityOid, const bsoncxx::oid& targetEntityOid);
 // High-level API for main.cpp
-crow::json::wvalue getRecommendations(const std::string& currentUserId, const std::string& type);
-crow::json::wvalue getUserWhoLikedEntity(const std::string& entityId, const std::string& type);
+std::optional<EntityKind> parseEntityType(const std::string& type);
+constexpr const char* kInvalidTypeError = "Invalid type parameter. Use 'roommate' or 'room'.";
+// Read endpoints return their JSON body already serialized (see JsonWriter.h); send it with jsonResponse(),
+// or jsonReadResponse() for the polled reads.
+std::string getRecommendations(const std::string& currentUserId, const std::string& type);
+std::string getUserWhoLikedEntity(const std::string& entityId, const std::string& type, const std::string& cursor = "", size_t limit = 50);
+
+/**
+ * Every user who liked an entity as one JSON document, `{"users":[...]}`, produced one page of
+ * kMaxLikesPageSize likers at a time so memory stays bounded by a single page. next() reads
+ * storage, so it runs on the DB executor (see offloadChunks()).
+ */
+class LikesStream {
+public:
+    LikesStream(std::string entityId, std::string type)
+        : entityId_(std::move(entityId)), type_(std::move(type)) {}
+
+    /// Appends the next page of the body to `out`. @return False once the body is complete.
+    bool next(std::string& out);
+    /// Appends the end of the body, with `error` in place of the likers not sent yet.
+    void fail(std::string& out, const std::string& error);
+
+private:
+    std::string entityId_, type_, cursor_;
+    bool started_ = false;
+    size_t emitted_ = 0;
+};
+std::string fetchUserInfo(const std::string& userId);
 crow::json::wvalue processSwipe(const std::string& sourceId, const std::string& targetId, const std::string& type, bool isLike);
+
+// Most swipes accepted by one /api/swipes request
+constexpr size_t kMaxSwipeBatchSize = 100;
+
+/// One swipe of a /api/swipes batch, as sent to /api/swipe.
+struct SwipeItem {
+    std::string sourceId, targetId, type;
+    bool isLike = false;
+    bool malformed = false;  // Missing or mistyped fields; reported without being processed
+};
+std::string processSwipes(const std::vector<SwipeItem>& swipes);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Storage.h"
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Storage held entirely in process memory, for benchmarks and load tests that should
+ * measure the API's own CPU cost without a mongod.
+ *
+ * Reads share a single reader-writer lock and writes take it exclusively. Nothing is
+ * persisted; the store starts from a JSON fixture (see loadFixture()) or empty.
+ */
+class MemoryStorage : public Storage {
+public:
+    MemoryStorage() = default;
+
+    /**
+     * Adds the users, rooms and swipes of a JSON fixture:
+     *
+     *   { "users": [ {"_id": "<24 hex>", "username": ..., "city": ..., ...} ],
+     *     "rooms": [ {"_id": ..., "ownerId": ..., ...} ],
+     *     "user_swipes": [ {"sourceEntityId": ..., "targetEntityId": [...]} ],
+     *     "room_swipes": [ ... ] }
+     *
+     * Documents use the MongoDB field names; ids may also be given as {"$oid": "..."} so
+     * mongoexport --jsonArray output can be pasted in. Seeded swipes count as likes.
+     * @throws std::runtime_error if the file cannot be read or parsed.
+     */
+    void loadFixture(const std::string& path);
+
+    /// Adds or replaces an entity.
+    void putEntity(EntityKind kind, EntityRecord record);
+
+    std::optional<EntityRecord> findEntity(EntityKind kind, const std::string& id) override;
+    std::vector<EntityRecord> findEntities(EntityKind kind, const std::vector<std::string>& ids) override;
+    std::vector<EntityRank> rankEntitiesInCity(EntityKind kind, const std::string& country, const std::string& city) override;
+    std::vector<Profile> loadProfiles() override;
+    bool recordSwipe(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) override;
+    bool hasSwiped(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) override;
+    bool recordLike(EntityKind targetKind, const std::string& likerId, const std::string& targetId) override;
+    std::vector<bool> recordSwipes(EntityKind targetKind, const std::string& sourceId, const std::vector<std::string>& targetIds) override;
+    std::vector<bool> recordLikes(EntityKind targetKind, const std::string& likerId, const std::vector<std::string>& targetIds) override;
+    LikersPage findLikers(EntityKind kind, const std::string& entityId, const std::string& cursor, size_t limit) override;
+    void applyCounterDeltas(EntityKind kind, CounterDeltaMap& deltas, std::vector<EntityCity>& changed) override;
+
+private:
+    struct EntityTable {
+        std::unordered_map<std::string, EntityRecord> byId;
+        // Ids per country + '\0' + city, the only secondary lookup the API needs
+        std::unordered_map<std::string, std::vector<std::string>> byCity;
+    };
+
+    struct SwipeTable {
+        std::unordered_map<std::string, std::unordered_set<std::string>> targetsBySource;
+        // Likers of each entity in arrival order, and the same likers as a set
+        std::unordered_map<std::string, std::vector<std::string>> likersByTarget;
+        std::unordered_map<std::string, std::unordered_set<std::string>> likerSetByTarget;
+    };
+
+    // Callers must hold mutex_
+    EntityTable& entities(EntityKind kind) { return kind == EntityKind::User ? users_ : rooms_; }
+    SwipeTable& swipes(EntityKind kind) { return kind == EntityKind::User ? userSwipes_ : roomSwipes_; }
+    void putEntityLocked(EntityKind kind, EntityRecord record);
+    bool recordSwipeLocked(EntityKind targetKind, const std::string& sourceId, const std::string& targetId);
+    bool recordLikeLocked(EntityKind targetKind, const std::string& likerId, const std::string& targetId);
+
+    std::shared_mutex mutex_;
+    EntityTable users_, rooms_;
+    SwipeTable userSwipes_, roomSwipes_;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+// Prometheus metrics for the HTTP server, served on /metrics in the text exposition format.
+//
+// Requests are recorded by MetricsMiddleware into a block owned by the io thread that served
+// them, with plain relaxed stores since each block has a single writer, so recording costs two
+// clock reads, a hash lookup of the path, the request's trace allocation and a handful of
+// uncontended stores. A scrape sums the blocks of every thread.
+
+#include "RequestTrace.h"
+#include <crow/crow_all.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * Crow middleware recording every request's latency in a histogram per route and status code,
+ * and the number of requests in flight.
+ *
+ * It also opens the request's RequestTrace (see RequestTrace.h) and, once the response is
+ * complete, records the trace's stages in a histogram per route and stage, logs the request if
+ * it was slow and returns its id in an X-Request-Id header.
+ *
+ * Routes are labelled with the request path; paths answered 404, and admin paths rejected by
+ * AdminAuthMiddleware, share the "unmatched" label so probes for random paths cannot grow the
+ * series count.
+ */
+struct MetricsMiddleware {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+        std::shared_ptr<RequestTrace> trace;
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+/// Every metric in the Prometheus text exposition format, version 0.0.4.
+std::string renderPrometheusMetrics();
+
+/// Appends the # HELP and # TYPE lines of a metric family.
+void appendMetricHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help);
+
+/**
+ * Appends one sample line.
+ * @param labels Rendered label pairs without braces, e.g. `route="/api/likes"`; empty for none.
+ */
+void appendMetricSample(std::string& out, std::string_view name, std::string_view labels, double value);
+
+/// Formats a sample value or bucket bound in the shortest form that reads back exactly.
+std::string formatMetricValue(double value);
+
+/// Escapes a label value: backslashes, double quotes and newlines.
+std::string escapeLabelValue(std::string_view value);
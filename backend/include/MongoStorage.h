@@ -0,0 +1,30 @@
+#pragma once
+
+#include "DBManager.h"
+#include "Storage.h"
+
+/**
+ * Storage backed by the "roommatefinder" MongoDB database. Every call leases a client from
+ * the DBManager pool for its duration.
+ */
+class MongoStorage : public Storage {
+public:
+    explicit MongoStorage(DBManager& manager);
+
+    std::optional<EntityRecord> findEntity(EntityKind kind, const std::string& id) override;
+    std::vector<EntityRecord> findEntities(EntityKind kind, const std::vector<std::string>& ids) override;
+    std::vector<EntityRank> rankEntitiesInCity(EntityKind kind, const std::string& country, const std::string& city) override;
+    std::vector<Profile> loadProfiles() override;
+    bool recordSwipe(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) override;
+    bool hasSwiped(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) override;
+    bool recordLike(EntityKind targetKind, const std::string& likerId, const std::string& targetId) override;
+    std::vector<bool> recordSwipes(EntityKind targetKind, const std::string& sourceId, const std::vector<std::string>& targetIds) override;
+    std::vector<std::string> findSwipersOf(EntityKind targetKind, const std::vector<std::string>& sourceIds, const std::string& targetId) override;
+    std::vector<bool> recordLikes(EntityKind targetKind, const std::string& likerId, const std::vector<std::string>& targetIds) override;
+    LikersPage findLikers(EntityKind kind, const std::string& entityId, const std::string& cursor, size_t limit) override;
+    void applyCounterDeltas(EntityKind kind, CounterDeltaMap& deltas, std::vector<EntityCity>& changed) override;
+    std::vector<std::string> prepare() override;
+
+private:
+    DBManager& manager_;
+};
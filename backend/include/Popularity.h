@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+// Popularity scoring shared by the swipe path, the popularity aggregator and batch recomputation
+double normalizeBudget(double budget);
+double normalizePopularity(double popularity, double minPopularity = -50, double maxPopularity = 3200);
+double calculatePopularity(int received, int made, int matches, double budget);
+double parseBudget(std::string budget);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Storage.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Folds swipe counter updates for users and rooms in memory and writes them back once per
+ * flush interval, so a profile receiving hundreds of likes a minute costs one
+ * counter update + popularity recompute per interval instead of one read-modify-write per like.
+ *
+ * Each thread records into its own shard, so recording only takes a lock that the flusher
+ * contends for once per interval.
+ */
+class PopularityAggregator {
+public:
+    /// @param flushInterval Time between flushes; at least 1 ms.
+    explicit PopularityAggregator(std::chrono::milliseconds flushInterval);
+    ~PopularityAggregator();
+
+    void recordSwipeReceived(EntityKind kind, const std::string& entityId);
+    void recordSwipeMade(EntityKind kind, const std::string& entityId);
+    void recordMatch(EntityKind kind, const std::string& entityId);
+
+    /// Writes all pending deltas now. Called by the flusher thread and on shutdown.
+    void flush();
+    /// Stops the flusher thread after a final flush.
+    void stop();
+
+private:
+    using Delta = CounterDelta;
+    using DeltaMap = CounterDeltaMap;
+
+    struct Shard {
+        std::mutex mutex;
+        DeltaMap users;
+        DeltaMap rooms;
+    };
+
+    static void mergeDeltas(DeltaMap& into, DeltaMap& from);
+    Shard& localShard();
+    Delta& localDelta(EntityKind kind, const std::string& entityId);
+    void flushKind(EntityKind kind, DeltaMap& deltas);
+    void run();
+
+    std::chrono::milliseconds flushInterval_;
+
+    std::mutex shardsMutex_;
+    std::vector<std::shared_ptr<Shard>> shards_;
+
+    // Deltas whose write failed, retried on the next flush. Only touched under flushMutex_.
+    std::mutex flushMutex_;
+    DeltaMap pendingUsers_;
+    DeltaMap pendingRooms_;
+
+    std::mutex stopMutex_;
+    std::condition_variable stopCv_;
+    bool stopping_ = false;
+    std::thread flusher_;
+};
+
+PopularityAggregator& getPopularityAggregator();
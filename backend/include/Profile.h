@@ -9,4 +9,10 @@
 struct Profile {
     std::string id, city, country, budget, state, zipcode;
     std::vector<std::string> tokens;
-};
\ No newline at end of file
+};
+
+/// Splits text into lowercase words. Safe to call from multiple threads.
+std::vector<std::string> tokenize(const std::string& text);
+
+/// Fills profile.tokens from its location and budget.
+void tokenizeProfile(Profile& profile);
\ No newline at end of file
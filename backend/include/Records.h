@@ -0,0 +1,102 @@
+#pragma once
+
+// Typed views of the documents read on hot paths, decoded with decodeBson<T>().
+
+#include "BsonDecode.h"
+#include "Storage.h"
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// A full user or room document.
+template <>
+struct BsonFields<EntityRecord> {
+    static constexpr auto fields = std::make_tuple(
+        bsonField("_id", &EntityRecord::id),
+        bsonField("ownerId", &EntityRecord::ownerId),
+        bsonField("username", &EntityRecord::username),
+        bsonField("firstName", &EntityRecord::firstName),
+        bsonField("lastName", &EntityRecord::lastName),
+        bsonField("email", &EntityRecord::email),
+        bsonField("phone", &EntityRecord::phone),
+        bsonField("gender", &EntityRecord::gender),
+        bsonField("address", &EntityRecord::address),
+        bsonField("address_line", &EntityRecord::address_line),
+        bsonField("city", &EntityRecord::city),
+        bsonField("state", &EntityRecord::state),
+        bsonField("country", &EntityRecord::country),
+        bsonField("zipcode", &EntityRecord::zipcode),
+        bsonField("budget", &EntityRecord::budget),
+        bsonField("popularity", &EntityRecord::popularity),
+        bsonField("matches", &EntityRecord::matches),
+        bsonField("swipesMade", &EntityRecord::swipesMade),
+        bsonField("swipesReceived", &EntityRecord::swipesReceived));
+};
+
+/// The ranking projection of a user or room.
+template <>
+struct BsonFields<EntityRank> {
+    static constexpr auto fields = std::make_tuple(
+        bsonField("_id", &EntityRank::id),
+        bsonField("ownerId", &EntityRank::ownerId),
+        bsonField("popularity", &EntityRank::popularity));
+};
+
+/// A liker as shown by /api/likes.
+struct LikerCard {
+    std::optional<bsoncxx::oid> id;
+    std::string_view username;
+    double popularity = 0.0;
+    int matches = 0;
+};
+
+template <>
+struct BsonFields<LikerCard> {
+    static constexpr auto fields = std::make_tuple(
+        bsonField("_id", &LikerCard::id),
+        bsonField("username", &LikerCard::username),
+        bsonField("popularity", &LikerCard::popularity),
+        bsonField("matches", &LikerCard::matches));
+};
+
+/// The inputs of calculatePopularity() plus the stored score.
+struct PopularityCounters {
+    std::optional<bsoncxx::oid> id;
+    int swipesReceived = 0;
+    int swipesMade = 0;
+    int matches = 0;
+    std::string_view budget = "0.0";
+    std::optional<double> popularity;
+    // Only read where the entity's city matters, e.g. by applyCounterDeltas()
+    std::string_view country, city;
+};
+
+template <>
+struct BsonFields<PopularityCounters> {
+    static constexpr auto fields = std::make_tuple(
+        bsonField("_id", &PopularityCounters::id),
+        bsonField("swipesReceived", &PopularityCounters::swipesReceived),
+        bsonField("swipesMade", &PopularityCounters::swipesMade),
+        bsonField("matches", &PopularityCounters::matches),
+        bsonField("budget", &PopularityCounters::budget),
+        bsonField("popularity", &PopularityCounters::popularity),
+        bsonField("country", &PopularityCounters::country),
+        bsonField("city", &PopularityCounters::city));
+};
+
+/// The location and budget fields tokenized by the recommender.
+struct ProfileFields {
+    std::optional<bsoncxx::oid> id;
+    std::string_view city, state, country, zipcode, budget;
+};
+
+template <>
+struct BsonFields<ProfileFields> {
+    static constexpr auto fields = std::make_tuple(
+        bsonField("_id", &ProfileFields::id),
+        bsonField("city", &ProfileFields::city),
+        bsonField("state", &ProfileFields::state),
+        bsonField("country", &ProfileFields::country),
+        bsonField("zipcode", &ProfileFields::zipcode),
+        bsonField("budget", &ProfileFields::budget));
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+// Per-request stage timings. MetricsMiddleware gives each request a RequestTrace with an id,
+// StageTimers in the handlers add the time spent in each stage to it, and once the response
+// is complete its stages go to the metrics histograms and, for a request slower than
+// SLOW_REQUEST_MS (default 500, 0 disables), to a structured slow-request log line on stderr.
+//
+// The trace travels with the request the same way its deadline does: it is current on the io
+// thread while the handler runs there, and submitRequest()/offload() make it current on the
+// DB worker running the request's work.
+
+#include "TraceCapture.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/// The stages a request's time is split into.
+enum class Stage {
+    Parse,      // Reading the request body
+    Queue,      // Waiting for a DB executor thread
+    DbFetch,    // Storage reads and writes, including decoding their results
+    Scoring,    // Computing candidate scores
+    TopK,       // Selecting and ordering the best candidates
+    Serialize,  // Building the response body
+};
+
+static constexpr size_t kStageCount = 6;
+
+/// The stage's name in logs and metric labels, e.g. "db".
+const char* stageName(Stage stage);
+
+/// A request's id and the time it spent in each stage so far.
+struct RequestTrace {
+    explicit RequestTrace(std::string requestId) : id(std::move(requestId)) {}
+
+    std::string id;
+    // Stages can be timed on the io thread and on a DB worker, so the sums are atomic
+    std::array<std::atomic<int64_t>, kStageCount> nanos{};
+
+    /// Adds time to a stage that ended just now, and records it as a span while a capture is armed.
+    void add(Stage stage, std::chrono::nanoseconds elapsed) {
+        nanos[static_cast<size_t>(stage)].fetch_add(elapsed.count(), std::memory_order_relaxed);
+        if (traceCaptureArmed()) traceComplete("stage", stageName(stage), TraceClock::now() - elapsed, elapsed);
+    }
+};
+
+/// The request id for a new request: its X-Request-Id header if it sent a usable one, else a fresh id.
+std::string makeRequestId(const std::string& requested);
+
+/// The trace of the request being handled on this thread, or null outside a request.
+const std::shared_ptr<RequestTrace>& currentRequestTrace();
+
+/**
+ * Makes `trace` current on this thread until another one is. Used on io threads, where a
+ * request's handler runs in legs between which other requests are handled.
+ */
+void setCurrentRequestTrace(std::shared_ptr<RequestTrace> trace);
+
+/// Makes `trace` current on this thread while in scope, e.g. on a DB worker.
+class RequestTraceScope {
+public:
+    explicit RequestTraceScope(std::shared_ptr<RequestTrace> trace);
+    ~RequestTraceScope();
+    RequestTraceScope(const RequestTraceScope&) = delete;
+    RequestTraceScope& operator=(const RequestTraceScope&) = delete;
+
+private:
+    std::shared_ptr<RequestTrace> saved_;
+};
+
+/**
+ * Adds the time until it goes out of scope to a stage of the current request. Outside a
+ * request it does nothing and does not read the clock.
+ */
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage)
+        : trace_(currentRequestTrace().get()), stage_(stage) {
+        if (trace_) start_ = std::chrono::steady_clock::now();
+    }
+    ~StageTimer() { stop(); }
+
+    /// Ends the stage early; the timer adds nothing more.
+    void stop() {
+        if (trace_) trace_->add(stage_, std::chrono::steady_clock::now() - start_);
+        trace_ = nullptr;
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    RequestTrace* trace_;
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Writes the slow-request log line of a finished request if it took at least SLOW_REQUEST_MS,
+ * as one JSON object: id, method, route, status, total and per-stage milliseconds.
+ */
+void logIfSlowRequest(const RequestTrace& trace, const char* method, const std::string& route, int status,
+                      std::chrono::nanoseconds total);
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "BlockingExecutor.h"
+#include "Compression.h"
+#include <crow/crow_all.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * How long each cacheable endpoint's responses are served from the response cache, overridable
+ * with RESPONSE_CACHE_RECOMMEND_TTL_MS, RESPONSE_CACHE_LIKES_TTL_MS and RESPONSE_CACHE_RANK_TTL_MS.
+ * A TTL of 0 keeps nothing, but identical requests in flight at the same time still share one run.
+ */
+struct ResponseCacheTtls {
+    std::chrono::milliseconds recommend;
+    std::chrono::milliseconds likes;
+    std::chrono::milliseconds rank;
+};
+
+const ResponseCacheTtls& getResponseCacheTtls();
+
+/**
+ * Sharded LRU cache of finished responses with single-flight coalescing. The first request for
+ * a key runs the handler; identical requests arriving while it runs wait for its response instead
+ * of running the handler again, and requests arriving later are served from the cache until the
+ * entry's TTL runs out.
+ *
+ * Keys carry the version counters of the data the response depends on (see ETag.h), so a write
+ * retires every entry built from the old data at once; superseded entries are never looked up
+ * again and age out of the LRU.
+ *
+ * Only 200 responses are cached; the read endpoints send their errors with a 4xx or 5xx code
+ * (see jsonReadResponse()), so an error is never served past the requests it was built for.
+ * Compressed variants are built by complete(), on the thread that produced the response, and
+ * kept with the entry, so serving a hit on an io thread never compresses.
+ */
+class ResponseCache {
+public:
+    /// A request waiting for a response, completed on its own io_context.
+    struct Waiter {
+        asio::io_context* io_context;
+        crow::response* res;
+        ContentEncoding encoding;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        int code;
+        crow::ci_map headers;
+        std::string body;
+        Clock::time_point expires;
+        // Compressed bodies per encoding (gzip, deflate), written before the entry is shared;
+        // an empty string means the body is sent uncompressed.
+        std::string variants[2];
+    };
+    using EntryPtr = std::shared_ptr<Entry>;
+
+    /// What lookup() found for a request.
+    struct Lookup {
+        EntryPtr entry;      // Set on a hit
+        bool lead = false;   // On a miss: true if the caller must run the handler and complete()
+    };
+
+    /**
+     * @param capacity Total number of responses kept; 0 disables caching but not coalescing.
+     * @param shardCount Number of independently locked shards.
+     */
+    ResponseCache(size_t capacity, size_t shardCount = 16);
+
+    /**
+     * Looks a key up. On a miss the waiter is queued for the key's response; the first waiter of
+     * a key leads and must run the handler, the others are completed along with it.
+     */
+    Lookup lookup(const std::string& key, const Waiter& waiter);
+
+    /**
+     * Finishes a key's run: compresses `result` for the encodings it will be served in, caches it
+     * for `ttl` if it is a 200 and completes every queued waiter with it. Call from the thread
+     * that produced the response, not from an io thread.
+     */
+    void complete(const std::string& key, crow::response result, std::chrono::milliseconds ttl, const CompressionPolicy& compression);
+
+    /// A cached response for a client accepting `encoding`, using the variant complete() built for it.
+    static crow::response respond(const Entry& entry, ContentEncoding encoding, const CompressionPolicy& compression);
+
+    int64_t hits() const { return hits_.load(); }
+    int64_t misses() const { return misses_.load(); }
+    int64_t coalesced() const { return coalesced_.load(); }
+    size_t size();
+
+private:
+    using LruList = std::list<std::pair<std::string, EntryPtr>>;
+
+    struct Shard {
+        std::mutex mutex;
+        // Most recently used first
+        LruList lru;
+        std::unordered_map<std::string, LruList::iterator> index;
+        std::unordered_map<std::string, std::vector<Waiter>> inFlight;
+    };
+
+    Shard& shardFor(const std::string& key);
+
+    size_t shardCapacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<int64_t> hits_{0};
+    std::atomic<int64_t> misses_{0};
+    std::atomic<int64_t> coalesced_{0};
+};
+
+/// The process-wide response cache, sized by RESPONSE_CACHE_SIZE (default 10000, 0 disables).
+ResponseCache& getResponseCache();
+
+/// Joins the parts of a cache key with a separator that cannot occur in them.
+std::string responseCacheKey(std::initializer_list<std::string_view> parts);
+
+/**
+ * Serves a request from the response cache, or queues it behind an identical request already
+ * in flight.
+ * @return False if the request missed and leads: the caller must produce the response and
+ *         pass it to getResponseCache().complete().
+ */
+inline bool serveCachedOrQueue(const crow::request& req, crow::response& res, const std::string& key, const CompressionPolicy& compression) {
+    auto encoding = compression.level > 0 ? negotiateEncoding(req.get_header_value("Accept-Encoding")) : ContentEncoding::Identity;
+    auto lookup = getResponseCache().lookup(key, {req.io_context, &res, encoding});
+    if (lookup.entry) {
+        res = ResponseCache::respond(*lookup.entry, encoding, compression);
+        res.end();
+        return true;
+    }
+    return !lookup.lead;
+}
+
+/**
+ * dispatchBlocking() in front of the response cache: serves a hit from the io thread, queues
+ * behind an identical request already in flight, or runs `work` on the DB executor and
+ * completes every request queued for `key` with its response.
+ * @param key The request's cache key, built with responseCacheKey().
+ * @param ttl How long the response stays cached; 0 to only coalesce.
+ */
+template <typename Work>
+void dispatchCached(const crow::request& req, crow::response& res, const std::string& key, std::chrono::milliseconds ttl,
+                    std::chrono::milliseconds budget, const CompressionPolicy& compression, Work work) {
+    if (serveCachedOrQueue(req, res, key, compression)) return;
+
+    bool queued = submitRequest(budget, std::move(work), [key, ttl, compression](crow::response result) {
+        getResponseCache().complete(key, std::move(result), ttl, compression);
+    });
+    if (!queued) {
+        getResponseCache().complete(key, executorBusyResponse(), ttl, compression);
+    }
+}
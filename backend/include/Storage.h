@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Profile.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class EntityKind { User, Room };
+
+/// A user or room. Fields the stored entity lacks are left at their defaults.
+struct EntityRecord {
+    std::string id, ownerId;
+    std::string username, firstName, lastName, email, phone, gender;
+    std::string address, address_line, city, state, country, zipcode;
+    std::string budget = "0.0";
+    double popularity = 0.0;
+    int matches = 0;
+    int swipesMade = 0;
+    int swipesReceived = 0;
+};
+
+/// The fields recommendations are ranked and filtered on.
+struct EntityRank {
+    std::string id, ownerId;
+    double popularity = 0.0;
+};
+
+/// A user who liked an entity, as listed by /api/likes.
+struct LikerRecord {
+    std::string id, username;
+    double popularity = 0.0;
+    std::optional<int> matches;  // Unset when the backend only keeps a denormalized card
+};
+
+/// One page of likers, with the cursor for the following page (empty on the last page).
+struct LikersPage {
+    std::vector<LikerRecord> likers;
+    std::string nextCursor;
+};
+
+/// Pending changes to an entity's swipe counters.
+struct CounterDelta {
+    int swipesReceived = 0;
+    int swipesMade = 0;
+    int matches = 0;
+};
+using CounterDeltaMap = std::unordered_map<std::string, CounterDelta>;
+
+/// The city an entity is listed in, which scopes the recommendations it appears in.
+struct EntityCity {
+    std::string country;
+    std::string city;
+};
+
+/**
+ * Repository of users, rooms and swipes. Everything above this interface is independent of
+ * the database, so the API can run against MongoDB or, for benchmarks and load tests, the
+ * in-memory store. Implementations must be safe to call from multiple threads.
+ *
+ * Ids are 24-character hex strings; backends may throw on ids they cannot parse.
+ */
+class Storage {
+public:
+    virtual ~Storage() = default;
+
+    /// The entity with this id, or std::nullopt.
+    virtual std::optional<EntityRecord> findEntity(EntityKind kind, const std::string& id) = 0;
+
+    /// The entities with these ids, in no particular order; missing ids are skipped.
+    virtual std::vector<EntityRecord> findEntities(EntityKind kind, const std::vector<std::string>& ids) = 0;
+
+    /// The ranking fields of every entity of `kind` located in the given city.
+    virtual std::vector<EntityRank> rankEntitiesInCity(EntityKind kind, const std::string& country, const std::string& city) = 0;
+
+    /// Every user's profile, tokenized for the recommender.
+    virtual std::vector<Profile> loadProfiles() = 0;
+
+    /**
+     * Records that user `sourceId` swiped on `targetId`.
+     * @return True if the source had not swiped on the target before.
+     */
+    virtual bool recordSwipe(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) = 0;
+
+    /// True if `sourceId` has swiped on `targetId` in the swipes of `targetKind`.
+    virtual bool hasSwiped(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) = 0;
+
+    /**
+     * Records that user `likerId` liked `targetId`, so it is listed by findLikers(). Safe to
+     * repeat: a liker is listed once however often its like is recorded.
+     * @return True if the liker was not listed before.
+     */
+    virtual bool recordLike(EntityKind targetKind, const std::string& likerId, const std::string& targetId) = 0;
+
+    // Batched forms of the swipe calls above, used by /api/swipes. The defaults make one call
+    // per id; backends override them to cover a batch in as few round trips as they can.
+
+    /**
+     * Records that user `sourceId` swiped on each of `targetIds`, which must be distinct.
+     * @return For each target, in order, true if the source had not swiped on it before.
+     */
+    virtual std::vector<bool> recordSwipes(EntityKind targetKind, const std::string& sourceId, const std::vector<std::string>& targetIds);
+
+    /// The members of `sourceIds` that have swiped on `targetId` in the swipes of `targetKind`.
+    virtual std::vector<std::string> findSwipersOf(EntityKind targetKind, const std::vector<std::string>& sourceIds, const std::string& targetId);
+
+    /**
+     * Records that user `likerId` liked each of `targetIds`, which must be distinct.
+     * @return For each target, in order, true if the liker was not listed before.
+     */
+    virtual std::vector<bool> recordLikes(EntityKind targetKind, const std::string& likerId, const std::vector<std::string>& targetIds);
+
+    /**
+     * Fetches one page of users who liked an entity, newest first where the backend can tell.
+     * @param cursor The `nextCursor` of the previous page, or empty for the first page.
+     * @throws std::invalid_argument if the cursor was not issued by this backend.
+     */
+    virtual LikersPage findLikers(EntityKind kind, const std::string& entityId, const std::string& cursor, size_t limit) = 0;
+
+    /**
+     * Adds each delta to its entity's counters and recomputes the entity's popularity,
+     * erasing deltas from `deltas` as they are applied. Deltas of missing entities are dropped.
+     * A delta whose counters were added but whose popularity was not written is left zeroed.
+     * @param changed Gets the city of every entity whose counters were added, also when it throws.
+     * @throws std::exception on a storage error, with the unapplied deltas left in `deltas`.
+     */
+    virtual void applyCounterDeltas(EntityKind kind, CounterDeltaMap& deltas, std::vector<EntityCity>& changed) = 0;
+
+    /**
+     * Gets the backend ready to serve before the server takes traffic, e.g. by creating the
+     * indexes its queries rely on.
+     * @return Problems that should keep the service out of rotation; empty when ready.
+     */
+    virtual std::vector<std::string> prepare() { return {}; }
+};
+
+/**
+ * The process-wide store, chosen on first use by ROOMMATE_STORAGE: "mongo" (default) or
+ * "memory". The memory store is seeded from the JSON fixture named by ROOMMATE_FIXTURE.
+ */
+Storage& getStorage();
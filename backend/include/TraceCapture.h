@@ -0,0 +1,76 @@
+#pragma once
+
+// On-demand capture of timing spans, exported as Chrome trace-event JSON for Perfetto or
+// chrome://tracing. While a capture is armed, request handling, MongoDB commands and handler
+// stages record span events into a ring buffer owned by the recording thread; when it ends,
+// the buffers are collected into one trace.
+//
+// Call sites guard every recording call with traceCaptureArmed(), so while no capture runs
+// tracing costs one relaxed load and a branch that is always predicted.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using TraceClock = std::chrono::steady_clock;
+
+/// Set while a capture is running; read through traceCaptureArmed().
+inline std::atomic<bool> traceCaptureActive{false};
+
+/// True while a capture is running.
+inline bool traceCaptureArmed() {
+    return traceCaptureActive.load(std::memory_order_relaxed);
+}
+
+/**
+ * Records a span that ran on this thread, e.g. a MongoDB command or a handler stage.
+ * @param category The span's category, e.g. "db".
+ * @param name The span's name; truncated to 31 bytes.
+ */
+void traceComplete(const char* category, std::string_view name, TraceClock::time_point start, TraceClock::duration duration);
+
+/**
+ * Records the start of a span that may end on another thread or after other work on this
+ * one, such as a request. Begin and end are matched by category, name and id.
+ */
+void traceAsyncBegin(const char* category, std::string_view name, uint64_t id);
+
+/// Records the end of a span started with traceAsyncBegin().
+void traceAsyncEnd(const char* category, std::string_view name, uint64_t id);
+
+/// A recorded event; `phase` is the trace-event phase: 'X' complete, 'b'/'e' async begin/end.
+struct TraceEvent {
+    char name[32];
+    const char* category;
+    int64_t startNanos;
+    int64_t durationNanos;
+    uint64_t id;
+    uint32_t thread;
+    char phase;
+};
+
+/// The events of a finished capture.
+struct TraceSnapshot {
+    std::vector<TraceEvent> events;
+    // Events overwritten because a thread's ring buffer was full
+    uint64_t overwritten = 0;
+};
+
+/**
+ * Starts a capture, discarding the events of the previous one. Each thread keeps its last
+ * TRACE_BUFFER_EVENTS events (default 16384).
+ * @return False if a capture is already running.
+ */
+bool armTraceCapture();
+
+/**
+ * Stops the running capture, waits for threads still recording an event and copies out
+ * every thread's events, so a new capture can start right away.
+ */
+TraceSnapshot finishTraceCapture();
+
+/// A capture as Chrome trace-event JSON, with one track per recording thread.
+std::string toChromeTraceJson(const TraceSnapshot& snapshot);
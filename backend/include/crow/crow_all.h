@@ -5630,6 +5630,11 @@ namespace crow
 #include <vector>
 #include <cmath>
 #include <cfloat>
+#include <cstddef>
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define CROW_JSON_ESCAPE_SSE2
+#include <emmintrin.h>
+#endif
 
 
 using std::isinf;
@@ -5653,11 +5658,58 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             return 'a' + c - 10;
         }
 
-        inline void escape(const std::string& str, std::string& ret)
+        /// Index of the first byte at or after `i` that needs escaping (a quote, a backslash or
+        /// a control character), or `size` if there is none.
+        inline size_t find_escape(const char* data, size_t i, size_t size)
+        {
+#ifdef CROW_JSON_ESCAPE_SSE2
+            // Test 16 bytes at a time; most strings in a response need no escaping at all
+            auto special_mask = [](const char* at) {
+                const __m128i quote = _mm_set1_epi8('"');
+                const __m128i backslash = _mm_set1_epi8('\\');
+                const __m128i last_control = _mm_set1_epi8(0x1f);
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+                // Unsigned c <= 0x1f, so bytes of multi-byte UTF-8 sequences are left alone
+                __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk);
+                __m128i special = _mm_or_si128(control, _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+                return static_cast<unsigned>(_mm_movemask_epi8(special));
+            };
+            for (; i + 16 <= size; i += 16)
+            {
+                unsigned mask = special_mask(data + i);
+                if (mask != 0)
+                    return i + __builtin_ctz(mask);
+            }
+            if (i < size && size >= 16)
+            {
+                // Cover the tail with one load ending at the last byte, ignoring bytes before i
+                size_t tail = size - 16;
+                unsigned mask = special_mask(data + tail) >> (i - tail);
+                return mask != 0 ? i + __builtin_ctz(mask) : size;
+            }
+#endif
+            for (; i < size; ++i)
+            {
+                unsigned char c = static_cast<unsigned char>(data[i]);
+                if (c < 0x20 || c == '"' || c == '\\')
+                    return i;
+            }
+            return size;
+        }
+
+        inline void escape(const char* data, size_t size, std::string& ret)
         {
-            ret.reserve(ret.size() + str.size() + str.size() / 4);
-            for (auto c : str)
+            ret.reserve(ret.size() + size + size / 4);
+            size_t run = 0;
+            for (;;)
             {
+                // Copy the run that needs no escaping in one append
+                size_t i = find_escape(data, run, size);
+                ret.append(data + run, i - run);
+                if (i == size)
+                    break;
+
+                char c = data[i];
                 switch (c)
                 {
                     case '"': ret += "\\\""; break;
@@ -5668,18 +5720,19 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                     case '\r': ret += "\\r"; break;
                     case '\t': ret += "\\t"; break;
                     default:
-                        if (c >= 0 && c < 0x20)
-                        {
-                            ret += "\\u00";
-                            ret += to_hex(c / 16);
-                            ret += to_hex(c % 16);
-                        }
-                        else
-                            ret += c;
+                        ret += "\\u00";
+                        ret += to_hex(c / 16);
+                        ret += to_hex(c % 16);
                         break;
                 }
+                run = i + 1;
             }
         }
+
+        inline void escape(const std::string& str, std::string& ret)
+        {
+            escape(str.data(), str.size(), ret);
+        }
         inline std::string escape(const std::string& str)
         {
             std::string ret;
@@ -7861,6 +7914,7 @@ namespace crow
             headers = std::move(r.headers);
             completed_ = r.completed_;
             file_info = std::move(r.file_info);
+            chunk_producer_ = std::move(r.chunk_producer_);
             return *this;
         }
 
@@ -7877,6 +7931,7 @@ namespace crow
             headers.clear();
             completed_ = false;
             file_info = static_file_info{};
+            chunk_producer_ = nullptr;
         }
 
         /// Return a "Temporary Redirect" response.
@@ -7938,7 +7993,10 @@ namespace crow
                 }
                 if (complete_request_handler_)
                 {
-                    complete_request_handler_();
+                    // Completing clears complete_request_handler_, which may drop the last reference to the connection
+                    // that owns this response (e.g. when ending from a posted handler). Keep it alive until we are done.
+                    auto complete_request_handler = complete_request_handler_;
+                    complete_request_handler();
                     manual_length_header = false;
                     skip_body = false;
                 }
@@ -7964,6 +8022,29 @@ namespace crow
             return file_info.path.size();
         }
 
+        /// Produces the next part of a chunked body by calling its argument exactly once, from any thread, with the part and whether more parts follow.
+        using chunk_producer = std::function<void(std::function<void(std::string, bool)>)>;
+
+        /// Stream the body with HTTP/1.1 chunked transfer encoding instead of sending a materialized body.
+
+        ///
+        /// The producer is called again only once the previous part has been written, so a slow client holds back production instead of buffering it.
+        /// It may hand the work to another thread: the connection writes each part asynchronously from its own thread.
+        void set_chunked_body(chunk_producer producer)
+        {
+            chunk_producer_ = std::move(producer);
+            set_header("Transfer-Encoding", "chunked");
+#ifdef CROW_ENABLE_COMPRESSION
+            compressed = false;
+#endif
+        }
+
+        /// Check whether the response body is produced in chunks.
+        bool is_chunked_type()
+        {
+            return static_cast<bool>(chunk_producer_);
+        }
+
         /// This constains metadata (coming from the `stat` command) related to any static files associated with this response.
 
         ///
@@ -8013,6 +8094,7 @@ namespace crow
         bool completed_{};
         std::function<void()> complete_request_handler_;
         std::function<bool()> is_alive_helper_;
+        chunk_producer chunk_producer_;
         static_file_info file_info;
     };
 } // namespace crow
@@ -9484,9 +9566,8 @@ namespace crow
 #endif
     using tcp = asio::ip::tcp;
 
-#ifdef CROW_ENABLE_DEBUG
-    static std::atomic<int> connectionCount;
-#endif
+    /// Connections currently open, for the application's metrics.
+    inline std::atomic<int> connectionCount{0};
 
     /// An HTTP connection.
     template<typename Adaptor, typename Handler, typename... Middlewares>
@@ -9515,16 +9596,16 @@ namespace crow
           res_stream_threshold_(handler->stream_threshold()),
           queue_length_(queue_length)
         {
-#ifdef CROW_ENABLE_DEBUG
             connectionCount++;
+#ifdef CROW_ENABLE_DEBUG
             CROW_LOG_DEBUG << "Connection (" << this << ") allocated, total: " << connectionCount;
 #endif
         }
 
         ~Connection()
         {
-#ifdef CROW_ENABLE_DEBUG
             connectionCount--;
+#ifdef CROW_ENABLE_DEBUG
             CROW_LOG_DEBUG << "Connection (" << this << ") freed, total: " << connectionCount;
 #endif
         }
@@ -9711,6 +9792,10 @@ namespace crow
             {
                 do_write_static();
             }
+            else if (res.is_chunked_type())
+            {
+                do_write_chunked();
+            }
             else
             {
                 do_write_general();
@@ -9803,7 +9888,7 @@ namespace crow
                 buffers_.emplace_back(crlf.data(), crlf.size());
             }
 
-            if (!res.manual_length_header && !res.headers.count("content-length"))
+            if (!res.manual_length_header && !res.is_chunked_type() && !res.headers.count("content-length"))
             {
                 content_length_ = std::to_string(res.body.size());
                 static std::string content_length_tag = "Content-Length: ";
@@ -9866,6 +9951,101 @@ namespace crow
             parser_.clear();
         }
 
+        void do_write_chunked()
+        {
+            chunk_producer_ = std::move(res.chunk_producer_);
+            cancel_deadline_timer();
+
+            auto self = this->shared_from_this();
+            asio::async_write(
+              adaptor_.socket(), buffers_, // Write the response start / headers
+              [self](const error_code& ec, std::size_t /*bytes_transferred*/) {
+                  if (ec)
+                  {
+                      CROW_LOG_ERROR << ec << " - happened while sending chunked response headers";
+                      self->finish_chunked(false);
+                      return;
+                  }
+                  self->produce_chunk();
+              });
+        }
+
+        void produce_chunk()
+        {
+            auto self = this->shared_from_this();
+            chunk_producer_([self](std::string chunk, bool more) {
+                asio::post(self->adaptor_.get_io_context(), [self, chunk = std::move(chunk), more]() mutable {
+                    self->write_chunk(std::move(chunk), more);
+                });
+            });
+        }
+
+        void write_chunk(std::string chunk, bool more)
+        {
+            if (!adaptor_.is_open())
+            {
+                finish_chunked(false);
+                return;
+            }
+
+            chunk_buffer_.clear();
+            if (!chunk.empty())
+            {
+                char size_line[24];
+                int size_line_length = snprintf(size_line, sizeof(size_line), "%zx\r\n", chunk.size());
+                chunk_buffer_.append(size_line, size_line_length).append(chunk).append(crlf);
+            }
+            if (!more)
+            {
+                chunk_buffer_ += "0\r\n\r\n";
+            }
+
+            auto self = this->shared_from_this();
+            asio::async_write(
+              adaptor_.socket(), asio::buffer(chunk_buffer_),
+              [self, more](const error_code& ec, std::size_t /*bytes_transferred*/) {
+                  if (ec)
+                  {
+                      CROW_LOG_ERROR << ec << " - happened while sending a response chunk";
+                      self->finish_chunked(false);
+                  }
+                  else if (more)
+                  {
+                      self->produce_chunk();
+                  }
+                  else
+                  {
+                      self->finish_chunked(true);
+                  }
+              });
+        }
+
+        void finish_chunked(bool written)
+        {
+            chunk_producer_ = nullptr;
+            chunk_buffer_.clear();
+            chunk_buffer_.shrink_to_fit();
+
+            if (!written || close_connection_)
+            {
+                adaptor_.shutdown_readwrite();
+                adaptor_.close();
+                CROW_LOG_DEBUG << this << " from write (chunked)";
+            }
+
+            res.end();
+            res.clear();
+            buffers_.clear();
+            parser_.clear();
+
+            if (written && need_to_start_read_after_complete_)
+            {
+                need_to_start_read_after_complete_ = false;
+                start_deadline();
+                do_read();
+            }
+        }
+
         void do_write_general()
         {
             if (res.body.length() < res_stream_threshold_)
@@ -9943,14 +10123,14 @@ namespace crow
                       self->parser_.done();
                       // adaptor will close after write
                   }
-                  else if (!self->need_to_call_after_handlers_)
+                  else if (!self->need_to_call_after_handlers_ && !self->chunk_producer_)
                   {
                       self->start_deadline();
                       self->do_read();
                   }
                   else
                   {
-                      // res will be completed later by user
+                      // res will be completed later by user, or its chunked body is still being written
                       self->need_to_start_read_after_complete_ = true;
                   }
               });
@@ -10053,6 +10233,8 @@ namespace crow
         std::string content_length_;
         std::string date_str_;
         std::string res_body_copy_;
+        response::chunk_producer chunk_producer_;
+        std::string chunk_buffer_;
 
         detail::task_timer::identifier_type task_id_{};
 
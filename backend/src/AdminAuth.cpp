@@ -0,0 +1,56 @@
+#include "AdminAuth.h"
+
+#include <cstdlib>
+#include <string>
+
+static constexpr std::string_view kAdminPrefix = "/api/admin/";
+static constexpr std::string_view kBearerPrefix = "Bearer ";
+
+static const std::string& adminToken() {
+    static const std::string token = getenv("ADMIN_TOKEN") ? getenv("ADMIN_TOKEN") : "";
+    return token;
+}
+
+/// Compares in time independent of where the strings first differ, so the token cannot be guessed byte by byte.
+static bool constantTimeEquals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+bool isLoopbackAddress(std::string_view address) {
+    if (address == "::1") return true;
+    if (address.substr(0, 7) == "::ffff:") address.remove_prefix(7);
+    return address.substr(0, 4) == "127.";
+}
+
+static bool isAdminPath(std::string_view url) {
+    return url.substr(0, kAdminPrefix.size()) == kAdminPrefix;
+}
+
+bool isAdminAuthRejection(const crow::request& req, const crow::response& res) {
+    return (res.code == 401 || res.code == 403) && isAdminPath(req.url);
+}
+
+void AdminAuthMiddleware::before_handle(crow::request& req, crow::response& res, context&) {
+    if (!isAdminPath(req.url)) return;
+
+    const auto& token = adminToken();
+    if (token.empty()) {
+        if (isLoopbackAddress(req.remote_ip_address)) return;
+        res.code = 403;
+        return res.end("Admin routes are only served on loopback; set ADMIN_TOKEN to allow remote access.");
+    }
+
+    std::string_view authorization = req.get_header_value("Authorization");
+    if (authorization.substr(0, kBearerPrefix.size()) == kBearerPrefix &&
+        constantTimeEquals(authorization.substr(kBearerPrefix.size()), token)) {
+        return;
+    }
+    res.code = 401;
+    res.set_header("WWW-Authenticate", "Bearer");
+    res.end("Missing or invalid admin token.");
+}
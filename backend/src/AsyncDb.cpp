@@ -0,0 +1,44 @@
+#include "AsyncDb.h"
+#include "JsonWriter.h"
+#include "Matcher.h"
+#include "Recommender.h"
+
+// Parameters are taken by value so they live in the coroutine frame across the suspension.
+// The work lambdas are named locals on purpose: GCC 12 miscompiles the lifetime of lambda
+// temporaries inside a co_await expression and destroys their captures twice.
+// Deadlines are taken before the first suspension so queueing counts against the budget.
+
+asio::awaitable<crow::response> asyncGetRecommendations(std::string currentUserId, std::string type) {
+    auto deadline = deadlineAfter(getEndpointBudgets().recommend);
+    auto work = [=] { return getRecommendations(currentUserId, type); };
+    auto body = co_await offload(std::move(work), deadline);
+    co_return jsonReadResponse(std::move(body));
+}
+
+asio::awaitable<crow::response> asyncGetUserWhoLikedEntity(std::string entityId, std::string type, std::string cursor, size_t limit) {
+    auto deadline = deadlineAfter(getEndpointBudgets().likes);
+    auto work = [=] { return getUserWhoLikedEntity(entityId, type, cursor, limit); };
+    auto body = co_await offload(std::move(work), deadline);
+    co_return jsonReadResponse(std::move(body));
+}
+
+asio::awaitable<crow::response> asyncProcessSwipe(std::string sourceId, std::string targetId, std::string type, bool isLike) {
+    auto deadline = deadlineAfter(getEndpointBudgets().swipe);
+    auto work = [=] { return processSwipe(sourceId, targetId, type, isLike); };
+    auto result = co_await offload(std::move(work), deadline);
+    co_return crow::response(result);
+}
+
+asio::awaitable<crow::response> asyncProcessSwipes(std::vector<SwipeItem> swipes) {
+    auto deadline = deadlineAfter(getEndpointBudgets().swipes);
+    auto work = [swipes = std::move(swipes)] { return processSwipes(swipes); };
+    auto body = co_await offload(std::move(work), deadline);
+    co_return jsonResponse(std::move(body));
+}
+
+asio::awaitable<crow::response> asyncRankUsers(std::string targetId, std::string type) {
+    auto deadline = deadlineAfter(getEndpointBudgets().rank);
+    auto work = [=] { return rankUsers(targetId, type); };
+    auto body = co_await offload(std::move(work), deadline);
+    co_return jsonResponse(std::move(body));
+}
@@ -0,0 +1,67 @@
+#include "BlockingExecutor.h"
+
+#include <cstdlib>
+
+BlockingExecutor::BlockingExecutor(size_t threads, size_t maxQueueDepth)
+    : maxQueueDepth_(maxQueueDepth) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { run(); });
+    }
+}
+
+BlockingExecutor::~BlockingExecutor() {
+    stop();
+}
+
+bool BlockingExecutor::trySubmit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || tasks_.size() >= maxQueueDepth_) {
+            rejected_++;
+            return false;
+        }
+        tasks_.push_back(std::move(task));
+    }
+    notEmpty_.notify_one();
+    return true;
+}
+
+void BlockingExecutor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    notEmpty_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+size_t BlockingExecutor::queueDepth() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tasks_.size();
+}
+
+void BlockingExecutor::run() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notEmpty_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            // Drain what is already queued before exiting so no request is left without a response
+            if (tasks_.empty()) return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            busy_++;
+        }
+        task();
+        busy_--;
+    }
+}
+
+BlockingExecutor& getDbExecutor() {
+    static BlockingExecutor executor(
+        getenv("DB_EXECUTOR_THREADS") ? std::atoi(getenv("DB_EXECUTOR_THREADS")) : 32,
+        getenv("DB_EXECUTOR_QUEUE") ? std::atoi(getenv("DB_EXECUTOR_QUEUE")) : 1024);
+    return executor;
+}
@@ -0,0 +1,158 @@
+#include "Compression.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+
+// Window bits for deflateInit2: 15 writes a zlib stream, +16 a gzip one
+static constexpr int kZlibWindowBits = 15;
+static constexpr int kGzipWindowBits = 15 | 16;
+
+static std::atomic<int64_t> responsesCompressed{0};
+static std::atomic<int64_t> bytesBefore{0};
+static std::atomic<int64_t> bytesAfter{0};
+
+static int envLevel(const char* name, int fallback) {
+    const char* value = getenv(name);
+    return std::clamp(value ? std::atoi(value) : fallback, 0, 9);
+}
+
+const CompressionPolicies& getCompressionPolicies() {
+    static const CompressionPolicies policies = [] {
+        const char* minBytesEnv = getenv("COMPRESSION_MIN_BYTES");
+        size_t minBytes = minBytesEnv ? std::strtoul(minBytesEnv, nullptr, 10) : 1024;
+        return CompressionPolicies{
+            {envLevel("COMPRESSION_RECOMMEND_LEVEL", 6), minBytes},
+            {envLevel("COMPRESSION_LIKES_LEVEL", 6), minBytes},
+            {envLevel("COMPRESSION_SWIPE_LEVEL", 1), minBytes},
+            {envLevel("COMPRESSION_SWIPES_LEVEL", 1), minBytes},
+            // Rankings list every user, so trade some ratio for speed
+            {envLevel("COMPRESSION_RANK_LEVEL", 4), minBytes},
+        };
+    }();
+    return policies;
+}
+
+static std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+/**
+ * The q-value of one Accept-Encoding element's parameters, e.g. ";q=0.5".
+ * A missing or unparsable q counts as 1.
+ */
+static double qValue(std::string_view params) {
+    while (!params.empty()) {
+        size_t end = params.find(';');
+        auto param = trim(params.substr(0, end));
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            std::string number(param.substr(2));
+            char* parsedEnd = nullptr;
+            double q = std::strtod(number.c_str(), &parsedEnd);
+            return parsedEnd == number.c_str() ? 1.0 : std::clamp(q, 0.0, 1.0);
+        }
+        if (end == std::string_view::npos) break;
+        params.remove_prefix(end + 1);
+    }
+    return 1.0;
+}
+
+ContentEncoding negotiateEncoding(std::string_view acceptEncoding) {
+    // -1 means the client did not mention the coding
+    double gzipQ = -1, deflateQ = -1, anyQ = -1;
+    while (!acceptEncoding.empty()) {
+        size_t end = acceptEncoding.find(',');
+        auto element = acceptEncoding.substr(0, end);
+        size_t semicolon = element.find(';');
+        auto coding = trim(element.substr(0, semicolon));
+        double q = semicolon == std::string_view::npos ? 1.0 : qValue(element.substr(semicolon + 1));
+
+        if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip")) gzipQ = q;
+        else if (equalsIgnoreCase(coding, "deflate")) deflateQ = q;
+        else if (coding == "*") anyQ = q;
+
+        if (end == std::string_view::npos) break;
+        acceptEncoding.remove_prefix(end + 1);
+    }
+
+    if (gzipQ < 0) gzipQ = anyQ;
+    if (deflateQ < 0) deflateQ = anyQ;
+    if (gzipQ <= 0 && deflateQ <= 0) return ContentEncoding::Identity;
+    return gzipQ >= deflateQ ? ContentEncoding::Gzip : ContentEncoding::Deflate;
+}
+
+const char* contentEncodingName(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip: return "gzip";
+        case ContentEncoding::Deflate: return "deflate";
+        default: return "";
+    }
+}
+
+/**
+ * Deflates in a single call into a buffer of deflateBound() bytes, which zlib guarantees is
+ * enough, instead of looping over a fixed scratch buffer and copying out of it.
+ */
+std::string compressBody(std::string_view body, ContentEncoding encoding, int level) {
+    if (encoding == ContentEncoding::Identity) return "";
+
+    z_stream stream{};
+    int windowBits = encoding == ContentEncoding::Gzip ? kGzipWindowBits : kZlibWindowBits;
+    if (deflateInit2(&stream, std::clamp(level, 1, 9), Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return "";
+    }
+
+    std::string compressed(deflateBound(&stream, body.size()), '\0');
+    // zlib does not take a const pointer; the input is not modified
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+    stream.avail_out = static_cast<uInt>(compressed.size());
+
+    int code = deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (code != Z_STREAM_END) {
+        std::cerr << "Response compression failed: zlib error " << code << std::endl;
+        return "";
+    }
+    return compressed;
+}
+
+void compressResponse(crow::response& res, ContentEncoding encoding, const CompressionPolicy& policy) {
+    if (policy.level <= 0) return;
+    res.add_header("Vary", "Accept-Encoding");
+    if (encoding == ContentEncoding::Identity || res.body.size() < std::max<size_t>(policy.minBytes, 1)) return;
+    if (!res.get_header_value("Content-Encoding").empty()) return;
+
+    auto compressed = compressBody(res.body, encoding, policy.level);
+    if (compressed.empty() || compressed.size() >= res.body.size()) return;
+
+    responsesCompressed++;
+    bytesBefore += res.body.size();
+    bytesAfter += compressed.size();
+    res.body = std::move(compressed);
+    res.set_header("Content-Encoding", contentEncodingName(encoding));
+}
+
+crow::json::wvalue getCompressionStats() {
+    crow::json::wvalue result;
+    int64_t before = bytesBefore.load();
+    int64_t after = bytesAfter.load();
+    result["responsesCompressed"] = responsesCompressed.load();
+    result["bytesBefore"] = before;
+    result["bytesAfter"] = after;
+    result["ratio"] = after ? static_cast<double>(before) / after : 0.0;
+    return result;
+}
@@ -1,96 +1,287 @@
 #include "DBManager.h"
-#include "Profile.h"    
+#include "DbMetrics.h"
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/exception/exception.hpp>
+#include <mongocxx/exception/server_error_code.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/options/client.hpp>
+#include <mongocxx/options/pool.hpp>
+#include <mongocxx/uri.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
 
-DBManager::DBManager(const std::string& mongo_uri)
-    : client_(mongocxx::uri{mongo_uri}) {
-    db = client_["roommatefinder"];
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+static int envInt(const char* name, int fallback) {
+    const char* value = getenv(name);
+    return value ? std::atoi(value) : fallback;
 }
 
-mongocxx::collection DBManager::getUserCollection() { return db["users"]; }
-mongocxx::collection DBManager::getRoomCollection() { return db["rooms"]; }
-mongocxx::collection DBManager::getUserSwipeCollection() { return db["user_swipes"]; }
-mongocxx::collection DBManager::getRoomSwipeCollection() { return db["room_swipes"]; }
+PoolOptions PoolOptions::fromEnv() {
+    PoolOptions options;
+    options.minPoolSize = envInt("MONGODB_POOL_MIN", options.minPoolSize);
+    options.maxPoolSize = envInt("MONGODB_POOL_MAX", options.maxPoolSize);
+    options.waitQueueTimeoutMS = envInt("MONGODB_POOL_WAIT_MS", options.waitQueueTimeoutMS);
+    return options;
+}
 
-DBManager& getDbManager() {
-    static mongocxx::instance inst{};
-    static DBManager dbManager(getenv("MONGODB_URI") ? getenv("MONGODB_URI") : "mongodb://localhost:27017");
-    return dbManager;
+/**
+ * Appends the pool sizing to a connection string, leaving options the URI already sets untouched.
+ * @param mongo_uri The MongoDB connection string.
+ * @param options The pool sizing.
+ * @return The connection string with pool options.
+ */
+static std::string withPoolOptions(const std::string& mongo_uri, const PoolOptions& options) {
+    std::string uri = mongo_uri;
+    auto query = uri.find('?');
+    if (query == std::string::npos) {
+        // Options need a "/" between the host list and the "?"
+        auto hosts = uri.find("://");
+        if (uri.find('/', hosts == std::string::npos ? 0 : hosts + 3) == std::string::npos) uri += '/';
+        uri += '?';
+    } else if (query + 1 != uri.size()) {
+        uri += '&';
+    }
+
+    auto append = [&](const std::string& key, int value) {
+        if (mongo_uri.find(key + "=") != std::string::npos) return;
+        if (uri.back() != '?' && uri.back() != '&') uri += '&';
+        uri += key + "=" + std::to_string(value);
+    };
+    append("minPoolSize", options.minPoolSize);
+    append("maxPoolSize", options.maxPoolSize);
+    append("waitQueueTimeoutMS", options.waitQueueTimeoutMS);
+    return uri;
 }
 
-crow::json::wvalue fetchUserInfo(const std::string& userId) {
-    crow::json::wvalue result;
+/**
+ * Pool options shared by every client: the APM listeners that feed the DB metrics.
+ */
+static mongocxx::options::pool makePoolOptions() {
+    mongocxx::options::client client_options;
+    client_options.apm_opts(makeDbApmOptions());
+    return mongocxx::options::pool{client_options};
+}
 
+DBManager::DBManager(const std::string& mongo_uri, const PoolOptions& options)
+    : options_(options), pool_(mongocxx::uri{withPoolOptions(mongo_uri, options)}, makePoolOptions()) {}
+
+ClientLease DBManager::acquire() {
+    auto start = std::chrono::steady_clock::now();
     try {
-        auto user_doc = user_collection.find_one(
-            document{} << "_id" << oid(userId) << finalize
-        );
+        auto entry = pool_.acquire();
+        waitNanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        acquired_++;
 
-        if (!user_doc) {
-            result["error"] = "User not found.";
-            return result;
-        }
+        int64_t inUse = ++inUse_;
+        int64_t peak = peakInUse_.load();
+        while (inUse > peak && !peakInUse_.compare_exchange_weak(peak, inUse)) {}
 
-        auto user_view = user_doc->view();
-        result["id"] = userId;
-        result["username"] =       user_view["username"]       ? std::string(user_view["username"].get_string().value) : "";
-        result["email"] =          user_view["email"]          ? std::string(user_view["email"].get_string().value) : "";
-        result["phone"] =          user_view["phone"]          ? std::string(user_view["phone"].get_string().value) : "";
-        result["gender"] =         user_view["gender"]         ? std::string(user_view["gender"].get_string().value) : "";
-        result["address"] =        user_view["address"]        ? std::string(user_view["address"].get_string().value) : "";
-        result["address_line"] =   user_view["address_line"]   ? std::string(user_view["address_line"].get_string().value) : "";
-        result["zipcode"] =        user_view["zipcode"]        ? std::string(user_view["zipcode"].get_string().value) : "";
-        result["city"] =           user_view["city"]           ? std::string(user_view["city"].get_string().value) : "";
-        result["state"] =          user_view["state"]          ? std::string(user_view["state"].get_string().value) : "";
-        result["country"] =        user_view["country"]        ? std::string(user_view["country"].get_string().value) : "";
-        result["budget"] =         user_view["budget"]         ? std::string(user_view["budget"].get_string().value) : "0.0";
-        result["popularity"] =     user_view["popularity"]     ? user_view["popularity"].get_double().value : 0.0;
-        result["matches"] =        user_view["matches"]        ? user_view["matches"].get_int32().value : 0;
-        result["swipesMade"] =     user_view["swipesMade"]     ? user_view["swipesMade"].get_int32().value : 0;
-        result["swipesReceived"] = user_view["swipesReceived"] ? user_view["swipesReceived"].get_int32().value : 0;
-
-    } catch (const std::exception& e) {
-        std::cerr << "Error fetching user info: " << e.what() << std::endl;
-        result["error"] = "Backend error: " + std::string(e.what());
+        return ClientLease(this, std::move(entry));
+    } catch (const mongocxx::exception& e) {
+        timeouts_++;
+        throw std::runtime_error(std::string("No MongoDB client available: ") + e.what());
     }
+}
 
-    return result;
+PoolStats DBManager::poolStats() const {
+    int64_t acquired = acquired_.load();
+    return PoolStats{
+        options_.maxPoolSize,
+        inUse_.load(),
+        peakInUse_.load(),
+        acquired,
+        timeouts_.load(),
+        acquired ? waitNanos_.load() / 1e6 / acquired : 0.0,
+    };
+}
+
+ClientLease::ClientLease(DBManager* manager, mongocxx::pool::entry entry)
+    : manager_(manager), entry_(std::move(entry)) {}
+
+ClientLease::ClientLease(ClientLease&& other) noexcept
+    : manager_(other.manager_),
+      entry_(std::move(other.entry_)),
+      db_(std::move(other.db_)),
+      users_(std::move(other.users_)),
+      rooms_(std::move(other.rooms_)),
+      userSwipes_(std::move(other.userSwipes_)),
+      roomSwipes_(std::move(other.roomSwipes_)),
+      userLikesInbox_(std::move(other.userLikesInbox_)),
+      roomLikesInbox_(std::move(other.roomLikesInbox_)) {
+    other.manager_ = nullptr;
 }
 
+mongocxx::database& ClientLease::getDatabase() {
+    if (!db_) db_.emplace((*entry_)["roommatefinder"]);
+    return *db_;
+}
 
 /**
- * Fetches user data from the database and tokenizes it for the recommender system.
- * @return A vector of Profile objects containing user data.
+ * Returns the lease's handle of a collection, creating it on first use.
  */
-std::vector<Profile> fetchUserData() {
-    try{
-        auto& db = getDbManager();
-        auto user_collection = db.getUserCollection();
-        std::vector<Profile> profiles;
-
-        for (auto&& doc : user_collection.find({})) {
-            Profile profile;
-            profile.id = doc["_id"].get_oid().value.to_string();
-
-            profile.city =      doc["city"]     ? std::string(doc["city"].get_string().value) : "";
-            profile.state =     doc["state"]    ? std::string(doc["state"].get_string().value) : "";
-            profile.country =   doc["country"]  ? std::string(doc["country"].get_string().value) : "";
-            profile.zipcode =   doc["zipcode"]  ? std::string(doc["zipcode"].get_string().value) : "";
-            profile.budget =    doc["budget"]   ? std::string(doc["budget"].get_string().value) : "";
-            
-            // TODO - Cap the number of tokens to more recent ones using timestamps
-            // TODO - Add preferences and interests to the recommender system
-            std::string all = profile.city + " " +
-                              profile.state + " " +
-                              profile.country + " " +
-                              profile.zipcode + " " +
-                              profile.budget;
-            profile.tokens = tokenize(all);
-            profiles.push_back(std::move(profile));
+mongocxx::collection& ClientLease::collection(std::optional<mongocxx::collection>& handle, const char* name) {
+    if (!handle) handle.emplace(getDatabase()[name]);
+    return *handle;
+}
+
+ClientLease::~ClientLease() {
+    if (manager_) manager_->inUse_--;
+}
+
+// --- Indexes ---
+
+using IndexKeys = std::vector<std::pair<const char*, int>>;
+
+struct RequiredIndex {
+    const char* collection;
+    IndexKeys keys;
+    bool unique = false;
+};
+
+// Indexes backing the queries in MongoStorage; keep in step with kHotQueries below
+static const std::vector<RequiredIndex> kRequiredIndexes = {
+    {"users",            {{"country", 1}, {"city", 1}}},
+    {"rooms",            {{"country", 1}, {"city", 1}}},
+    {"rooms",            {{"ownerId", 1}}},
+    {"user_swipes",      {{"sourceEntityId", 1}}},
+    {"room_swipes",      {{"sourceEntityId", 1}}},
+    {"user_swipes",      {{"targetEntityId", 1}, {"_id", 1}}},
+    {"room_swipes",      {{"targetEntityId", 1}, {"_id", 1}}},
+    {"user_likes_inbox", {{"entityId", 1}, {"_id", 1}}},
+    {"room_likes_inbox", {{"entityId", 1}, {"_id", 1}}},
+    // Unique: it is what keeps concurrent pushes of one like from listing the liker twice
+    {"user_likes_inbox", {{"entityId", 1}, {"likers.id", 1}}, true},
+    {"room_likes_inbox", {{"entityId", 1}, {"likers.id", 1}}, true},
+};
+
+struct HotQuery {
+    const char* description;
+    const char* collection;
+    std::vector<const char*> filterFields;
+    IndexKeys sort;
+};
+
+// The query shapes on request paths, as run by MongoStorage
+static const std::vector<HotQuery> kHotQueries = {
+    {"users by city",                "users",            {"country", "city"},  {}},
+    {"rooms by city",                "rooms",            {"country", "city"},  {}},
+    {"user swipes by source",        "user_swipes",      {"sourceEntityId"},   {}},
+    {"room swipes by source",        "room_swipes",      {"sourceEntityId"},   {}},
+    {"user likers from swipes",      "user_swipes",      {"targetEntityId"},   {{"_id", 1}}},
+    {"room likers from swipes",      "room_swipes",      {"targetEntityId"},   {{"_id", 1}}},
+    {"user likers from inbox",       "user_likes_inbox", {"entityId"},         {{"_id", -1}}},
+    {"room likers from inbox",       "room_likes_inbox", {"entityId"},         {{"_id", -1}}},
+    {"user inbox likers by id",      "user_likes_inbox", {"entityId", "likers.id"}, {}},
+    {"room inbox likers by id",      "room_likes_inbox", {"entityId", "likers.id"}, {}},
+};
+
+static bsoncxx::document::value keysDocument(const IndexKeys& keys) {
+    bsoncxx::builder::basic::document doc;
+    for (const auto& [field, direction] : keys) {
+        doc.append(kvp(field, direction));
+    }
+    return doc.extract();
+}
+
+void DBManager::ensureIndexes() {
+    auto client = acquire();
+    auto& db = client.getDatabase();
+    for (const auto& index : kRequiredIndexes) {
+        try {
+            db[index.collection].create_index(keysDocument(index.keys).view(), make_document(kvp("unique", index.unique)));
+        } catch (const mongocxx::exception& e) {
+            // Not an answer from the server, e.g. none could be selected: every other index would
+            // wait out the same timeout, so give up on the rest
+            if (e.code().category() != mongocxx::server_error_category()) throw;
+            // e.g. the same keys already indexed under another name, or no createIndex privilege
+            std::cerr << "Could not create index " << bsoncxx::to_json(keysDocument(index.keys).view())
+                      << " on " << index.collection << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+/**
+ * True if any stage of a plan, at any depth, is a collection scan. Rejected plans are skipped,
+ * including those of each shard in a sharded plan.
+ * @param plan A plan tree, e.g. the planner's winning plan.
+ */
+static bool hasCollectionScan(const bsoncxx::document::view& plan) {
+    for (auto&& element : plan) {
+        switch (element.type()) {
+            case bsoncxx::type::k_string:
+                if (element.key() == "stage" && element.get_string().value == "COLLSCAN") return true;
+                break;
+            case bsoncxx::type::k_document:
+                if (hasCollectionScan(element.get_document().value)) return true;
+                break;
+            case bsoncxx::type::k_array:
+                if (element.key() == "rejectedPlans") break;
+                for (auto&& item : element.get_array().value) {
+                    if (item.type() == bsoncxx::type::k_document && hasCollectionScan(item.get_document().value)) return true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> DBManager::findCollectionScans() {
+    auto client = acquire();
+    auto& db = client.getDatabase();
+
+    std::vector<std::string> scans;
+    for (const auto& query : kHotQueries) {
+        // Plans depend on the fields involved, not their values
+        bsoncxx::builder::basic::document filter;
+        for (const char* field : query.filterFields) {
+            filter.append(kvp(field, ""));
+        }
+        bsoncxx::builder::basic::document find;
+        find.append(kvp("find", query.collection), kvp("filter", filter.extract()));
+        if (!query.sort.empty()) find.append(kvp("sort", keysDocument(query.sort)));
+
+        auto explained = db.run_command(make_document(
+            kvp("explain", find.extract()),
+            kvp("verbosity", "queryPlanner")));
+        // Only the plan that runs matters; rejectedPlans often include a COLLSCAN alternative
+        auto planner = explained.view()["queryPlanner"];
+        if (!planner || planner.type() != bsoncxx::type::k_document) continue;
+        auto winning = planner.get_document().value["winningPlan"];
+        if (winning && winning.type() == bsoncxx::type::k_document && hasCollectionScan(winning.get_document().value)) {
+            scans.push_back(std::string(query.description) + " (" + query.collection + ")");
         }
-        return profiles;
-    } catch (const std::exception& e) {
-        std::cerr << "Error fetching user data: " << e.what() << std::endl;
-        throw std::runtime_error("Failed to fetch user data");
     }
-}
\ No newline at end of file
+    return scans;
+}
+
+DBManager& getDbManager() {
+    static mongocxx::instance inst{};
+    static DBManager dbManager(getenv("MONGODB_URI") ? getenv("MONGODB_URI") : "mongodb://localhost:27017");
+    return dbManager;
+}
+
+/**
+ * Reports the occupancy of the MongoDB client pool.
+ * @return A JSON object with the pool size, leases in use and lease wait statistics.
+ */
+crow::json::wvalue getDbPoolStats() {
+    auto stats = getDbManager().poolStats();
+    crow::json::wvalue result;
+    result["maxPoolSize"] = stats.maxPoolSize;
+    result["inUse"] = stats.inUse;
+    result["peakInUse"] = stats.peakInUse;
+    result["acquired"] = stats.acquired;
+    result["timeouts"] = stats.timeouts;
+    result["avgWaitMs"] = stats.avgWaitMs;
+    return result;
+}
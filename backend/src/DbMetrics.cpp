@@ -0,0 +1,385 @@
+#include "DbMetrics.h"
+
+#include "Metrics.h"
+#include "RequestTrace.h"
+#include "TraceCapture.h"
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/events/command_failed_event.hpp>
+#include <mongocxx/events/command_started_event.hpp>
+#include <mongocxx/events/command_succeeded_event.hpp>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// Upper bounds of the command latency buckets, in microseconds; the last bucket is unbounded
+static constexpr std::array<int64_t, 13> kLatencyBoundsUs = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+};
+
+// Samples a command needs before its percentiles are trusted
+static constexpr int64_t kMinPercentileSamples = 100;
+
+// Upper bounds of the round-trips-per-request buckets; the last bucket is unbounded
+static constexpr std::array<int, 11> kRoundTripBounds = {0, 1, 2, 3, 4, 5, 6, 8, 10, 15, 20};
+
+namespace {
+
+struct CommandStats {
+    std::atomic<int64_t> count{0};
+    std::atomic<int64_t> failures{0};
+    std::atomic<int64_t> totalMicros{0};
+    std::atomic<int64_t> maxMicros{0};
+    std::array<std::atomic<int64_t>, kLatencyBoundsUs.size() + 1> buckets{};
+};
+
+struct RequestStats {
+    std::atomic<int64_t> count{0};
+    std::atomic<int64_t> totalRoundTrips{0};
+    std::array<std::atomic<int64_t>, kRoundTripBounds.size() + 1> buckets{};
+};
+
+// What the started event knows that the succeeded/failed events do not
+struct StartedCommand {
+    std::string collection;
+    std::string filterShape;
+};
+
+struct RequestCounters {
+    bool active = false;
+    int roundTrips = 0;
+    int64_t micros = 0;
+};
+
+} // namespace
+
+static std::shared_mutex commandsMutex;
+static std::unordered_map<std::string, std::unique_ptr<CommandStats>> commands;
+static RequestStats requests;
+static std::atomic<int64_t> hedgedReads{0};
+
+// Command events fire on the thread running the command, so request-scoped state is thread-local
+static thread_local std::unordered_map<int64_t, StartedCommand> inFlight;
+static thread_local RequestCounters requestCounters;
+
+static int64_t slowQueryMicros() {
+    static const int64_t micros = (getenv("DB_SLOW_QUERY_MS") ? std::atoll(getenv("DB_SLOW_QUERY_MS")) : 100) * 1000;
+    return micros;
+}
+
+static std::string statsKey(const std::string& command, const std::string& collection) {
+    return collection.empty() ? command : command + " " + collection;
+}
+
+static CommandStats& statsFor(const std::string& key) {
+    {
+        std::shared_lock<std::shared_mutex> lock(commandsMutex);
+        auto it = commands.find(key);
+        if (it != commands.end()) return *it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(commandsMutex);
+    auto& stats = commands[key];
+    if (!stats) stats = std::make_unique<CommandStats>();
+    return *stats;
+}
+
+/**
+ * The collection a command targets: the value of its first element for most commands,
+ * or its `collection` field for getMore.
+ */
+static std::string collectionOf(const bsoncxx::document::view& command) {
+    auto first = command.begin();
+    if (first != command.end() && first->type() == bsoncxx::type::k_string) {
+        auto name = first->get_string().value;
+        return std::string(name.data(), name.size());
+    }
+    auto collection = command["collection"];
+    if (collection && collection.type() == bsoncxx::type::k_string) {
+        auto name = collection.get_string().value;
+        return std::string(name.data(), name.size());
+    }
+    return "";
+}
+
+/**
+ * Writes a document with every value replaced by `?`, keeping field names and operators,
+ * e.g. {"targetEntityId":?,"_id":{"$gt":?}}.
+ */
+static void writeShape(std::ostringstream& out, const bsoncxx::document::view& doc) {
+    out << '{';
+    bool first = true;
+    for (auto&& element : doc) {
+        if (!first) out << ',';
+        first = false;
+        auto key = element.key();
+        out << '"' << std::string(key.data(), key.size()) << "\":";
+        if (element.type() == bsoncxx::type::k_document) {
+            writeShape(out, element.get_document().value);
+        } else if (element.type() == bsoncxx::type::k_array) {
+            out << "[?]";
+        } else {
+            out << '?';
+        }
+    }
+    out << '}';
+}
+
+/**
+ * The shape of a command's query filter: `filter` for find/count, `query` for findAndModify,
+ * or the first statement's `q` for update and delete.
+ */
+static std::string filterShapeOf(const bsoncxx::document::view& command) {
+    bsoncxx::document::element filter = command["filter"];
+    if (!filter) filter = command["query"];
+    for (const char* statements : {"updates", "deletes"}) {
+        auto list = command[statements];
+        if (!filter && list && list.type() == bsoncxx::type::k_array) {
+            auto first = list.get_array().value.begin();
+            if (first != list.get_array().value.end() && first->type() == bsoncxx::type::k_document) {
+                filter = first->get_document().value["q"];
+            }
+        }
+    }
+    if (!filter || filter.type() != bsoncxx::type::k_document) return "";
+
+    std::ostringstream out;
+    writeShape(out, filter.get_document().value);
+    return out.str();
+}
+
+/**
+ * Records a finished command in its histogram, in the current request's counters and, when
+ * it ran longer than the slow-query threshold, in the log.
+ */
+static void recordCommand(int64_t requestId, const std::string& commandName, int64_t micros, bool failed) {
+    StartedCommand started;
+    auto it = inFlight.find(requestId);
+    if (it != inFlight.end()) {
+        started = std::move(it->second);
+        inFlight.erase(it);
+    }
+
+    auto& stats = statsFor(statsKey(commandName, started.collection));
+    stats.count++;
+    if (failed) stats.failures++;
+    stats.totalMicros += micros;
+    int64_t max = stats.maxMicros.load();
+    while (micros > max && !stats.maxMicros.compare_exchange_weak(max, micros)) {}
+    size_t bucket = 0;
+    while (bucket < kLatencyBoundsUs.size() && micros > kLatencyBoundsUs[bucket]) bucket++;
+    stats.buckets[bucket]++;
+
+    if (traceCaptureArmed()) {
+        auto duration = std::chrono::microseconds(micros);
+        traceComplete("db", started.collection.empty() ? commandName : commandName + " " + started.collection,
+                      TraceClock::now() - duration, duration);
+    }
+
+    if (requestCounters.active) {
+        requestCounters.roundTrips++;
+        requestCounters.micros += micros;
+    }
+
+    int64_t threshold = slowQueryMicros();
+    if (threshold > 0 && micros >= threshold) {
+        const auto& trace = currentRequestTrace();
+        std::cerr << "Slow MongoDB command: " << commandName << " " << started.collection
+                  << " " << micros / 1000.0 << "ms" << (failed ? " (failed)" : "")
+                  << (started.filterShape.empty() ? "" : " filter=" + started.filterShape)
+                  << (trace ? " request=" + trace->id : "") << std::endl;
+    }
+}
+
+mongocxx::options::apm makeDbApmOptions() {
+    mongocxx::options::apm apm;
+    apm.on_command_started([](const mongocxx::events::command_started_event& event) {
+        auto command = event.command();
+        StartedCommand started;
+        started.collection = collectionOf(command);
+        if (slowQueryMicros() > 0) started.filterShape = filterShapeOf(command);
+        inFlight[event.request_id()] = std::move(started);
+    });
+    apm.on_command_succeeded([](const mongocxx::events::command_succeeded_event& event) {
+        auto name = event.command_name();
+        recordCommand(event.request_id(), std::string(name.data(), name.size()), event.duration(), false);
+    });
+    apm.on_command_failed([](const mongocxx::events::command_failed_event& event) {
+        auto name = event.command_name();
+        recordCommand(event.request_id(), std::string(name.data(), name.size()), event.duration(), true);
+    });
+    return apm;
+}
+
+crow::json::wvalue getDbMetrics() {
+    crow::json::wvalue result;
+    result["slowQueryMs"] = slowQueryMicros() / 1000;
+    result["hedgedReads"] = hedgedReads.load();
+
+    result["commands"] = crow::json::wvalue::object();
+    {
+        std::shared_lock<std::shared_mutex> lock(commandsMutex);
+        for (const auto& [key, stats] : commands) {
+            int64_t count = stats->count.load();
+            crow::json::wvalue entry;
+            entry["count"] = count;
+            entry["failures"] = stats->failures.load();
+            entry["avgMs"] = count ? stats->totalMicros.load() / 1000.0 / count : 0.0;
+            entry["maxMs"] = stats->maxMicros.load() / 1000.0;
+            for (size_t i = 0; i < stats->buckets.size(); ++i) {
+                crow::json::wvalue bucket;
+                if (i < kLatencyBoundsUs.size()) bucket["leMs"] = kLatencyBoundsUs[i] / 1000.0;
+                else bucket["leMs"] = "+Inf";
+                bucket["count"] = stats->buckets[i].load();
+                entry["buckets"][i] = std::move(bucket);
+            }
+            result["commands"][key] = std::move(entry);
+        }
+    }
+
+    int64_t count = requests.count.load();
+    result["requests"]["count"] = count;
+    result["requests"]["avgRoundTrips"] = count ? static_cast<double>(requests.totalRoundTrips.load()) / count : 0.0;
+    for (size_t i = 0; i < requests.buckets.size(); ++i) {
+        crow::json::wvalue bucket;
+        if (i < kRoundTripBounds.size()) bucket["le"] = kRoundTripBounds[i];
+        else bucket["le"] = "+Inf";
+        bucket["count"] = requests.buckets[i].load();
+        result["requests"]["roundTrips"][i] = std::move(bucket);
+    }
+    return result;
+}
+
+/// The Prometheus labels of a command's stats key, e.g. command="find",collection="users".
+static std::string commandLabels(const std::string& key) {
+    size_t space = key.find(' ');
+    return "command=\"" + escapeLabelValue(key.substr(0, space)) + "\",collection=\"" +
+           (space == std::string::npos ? "" : escapeLabelValue(key.substr(space + 1))) + "\"";
+}
+
+void appendDbPrometheusMetrics(std::string& out) {
+    appendMetricHeader(out, "roommate_db_command_duration_seconds", "histogram", "MongoDB command latency by command and collection.");
+    {
+        std::shared_lock<std::shared_mutex> lock(commandsMutex);
+        for (const auto& [key, stats] : commands) {
+            std::string labels = commandLabels(key);
+            int64_t cumulative = 0;
+            for (size_t i = 0; i < stats->buckets.size(); ++i) {
+                cumulative += stats->buckets[i].load();
+                std::string bound = i < kLatencyBoundsUs.size() ? formatMetricValue(kLatencyBoundsUs[i] / 1e6) : "+Inf";
+                appendMetricSample(out, "roommate_db_command_duration_seconds_bucket", labels + ",le=\"" + bound + "\"",
+                                   static_cast<double>(cumulative));
+            }
+            appendMetricSample(out, "roommate_db_command_duration_seconds_sum", labels, stats->totalMicros.load() / 1e6);
+            appendMetricSample(out, "roommate_db_command_duration_seconds_count", labels, static_cast<double>(stats->count.load()));
+        }
+    }
+
+    appendMetricHeader(out, "roommate_db_command_failures_total", "counter", "MongoDB commands that failed, by command and collection.");
+    {
+        std::shared_lock<std::shared_mutex> lock(commandsMutex);
+        for (const auto& [key, stats] : commands) {
+            std::string labels = commandLabels(key);
+            appendMetricSample(out, "roommate_db_command_failures_total", labels, static_cast<double>(stats->failures.load()));
+        }
+    }
+
+    appendMetricHeader(out, "roommate_db_round_trips", "histogram", "MongoDB round trips made by each request's DB work.");
+    int64_t cumulative = 0;
+    for (size_t i = 0; i < requests.buckets.size(); ++i) {
+        cumulative += requests.buckets[i].load();
+        std::string bound = i < kRoundTripBounds.size() ? std::to_string(kRoundTripBounds[i]) : "+Inf";
+        appendMetricSample(out, "roommate_db_round_trips_bucket", "le=\"" + bound + "\"", static_cast<double>(cumulative));
+    }
+    appendMetricSample(out, "roommate_db_round_trips_sum", "", static_cast<double>(requests.totalRoundTrips.load()));
+    appendMetricSample(out, "roommate_db_round_trips_count", "", static_cast<double>(requests.count.load()));
+
+    appendMetricHeader(out, "roommate_db_hedged_reads_total", "counter", "Reads hedged with a second attempt.");
+    appendMetricSample(out, "roommate_db_hedged_reads_total", "", static_cast<double>(hedgedReads.load()));
+}
+
+int64_t commandLatencyPercentileMicros(const std::string& command, const std::string& collection, double percentile) {
+    std::shared_lock<std::shared_mutex> lock(commandsMutex);
+    auto it = commands.find(statsKey(command, collection));
+    if (it == commands.end()) return 0;
+
+    const auto& stats = *it->second;
+    int64_t count = stats.count.load();
+    if (count < kMinPercentileSamples) return 0;
+
+    int64_t rank = static_cast<int64_t>(percentile * count);
+    int64_t seen = 0;
+    for (size_t i = 0; i < kLatencyBoundsUs.size(); ++i) {
+        seen += stats.buckets[i].load();
+        if (seen > rank) return kLatencyBoundsUs[i];
+    }
+    return kLatencyBoundsUs.back();
+}
+
+void countHedgedRead() {
+    hedgedReads++;
+}
+
+DbRequestScope::DbRequestScope()
+    : savedRoundTrips_(requestCounters.roundTrips),
+      savedMicros_(requestCounters.micros),
+      savedActive_(requestCounters.active) {
+    requestCounters = RequestCounters{true, 0, 0};
+}
+
+DbRequestScope::~DbRequestScope() {
+    int roundTrips = requestCounters.roundTrips;
+    requests.count++;
+    requests.totalRoundTrips += roundTrips;
+    size_t bucket = 0;
+    while (bucket < kRoundTripBounds.size() && roundTrips > kRoundTripBounds[bucket]) bucket++;
+    requests.buckets[bucket]++;
+
+    requestCounters = RequestCounters{savedActive_, savedRoundTrips_, savedMicros_};
+}
+
+int DbRequestScope::roundTrips() const {
+    return requestCounters.roundTrips;
+}
+
+double DbRequestScope::dbMillis() const {
+    return requestCounters.micros / 1000.0;
+}
+
+void DbRequestScope::annotate(crow::response& res) const {
+    if (requestCounters.roundTrips == 0) return;
+    std::ostringstream timing;
+    timing << "db;dur=" << dbMillis() << ";desc=\"" << requestCounters.roundTrips << " round trips\"";
+    res.add_header("Server-Timing", timing.str());
+}
+
+DbWorkScope::DbWorkScope()
+    : savedRoundTrips_(requestCounters.roundTrips),
+      savedMicros_(requestCounters.micros),
+      savedActive_(requestCounters.active) {
+    requestCounters = RequestCounters{true, 0, 0};
+}
+
+DbWorkScope::~DbWorkScope() {
+    requestCounters = RequestCounters{savedActive_, savedRoundTrips_, savedMicros_};
+}
+
+int DbWorkScope::roundTrips() const {
+    return requestCounters.roundTrips;
+}
+
+int64_t DbWorkScope::micros() const {
+    return requestCounters.micros;
+}
+
+void addToDbRequest(int roundTrips, int64_t micros) {
+    if (!requestCounters.active) return;
+    requestCounters.roundTrips += roundTrips;
+    requestCounters.micros += micros;
+}
@@ -0,0 +1,52 @@
+#include "Deadline.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+static thread_local DeadlineClock::time_point threadDeadline = DeadlineClock::time_point::max();
+
+static std::chrono::milliseconds envBudget(const char* name, int fallbackMs) {
+    const char* value = getenv(name);
+    return std::chrono::milliseconds(std::max(0, value ? std::atoi(value) : fallbackMs));
+}
+
+const EndpointBudgets& getEndpointBudgets() {
+    static const EndpointBudgets budgets{
+        envBudget("DEADLINE_RECOMMEND_MS", 2000),
+        envBudget("DEADLINE_LIKES_MS", 1000),
+        envBudget("DEADLINE_SWIPE_MS", 2000),
+        envBudget("DEADLINE_SWIPES_MS", 5000),
+        // Ranking loads every profile, so it gets a much larger budget
+        envBudget("DEADLINE_RANK_MS", 30000),
+    };
+    return budgets;
+}
+
+DeadlineClock::time_point deadlineAfter(std::chrono::milliseconds budget) {
+    if (budget.count() <= 0) return DeadlineClock::time_point::max();
+    return DeadlineClock::now() + budget;
+}
+
+DeadlineScope::DeadlineScope(DeadlineClock::time_point deadline) : saved_(threadDeadline) {
+    threadDeadline = std::min(threadDeadline, deadline);
+}
+
+DeadlineScope::~DeadlineScope() {
+    threadDeadline = saved_;
+}
+
+bool DeadlineScope::expired() const {
+    return threadDeadline != DeadlineClock::time_point::max() && DeadlineClock::now() >= threadDeadline;
+}
+
+DeadlineClock::time_point currentDeadline() {
+    return threadDeadline;
+}
+
+std::optional<std::chrono::milliseconds> remainingBudget() {
+    if (threadDeadline == DeadlineClock::time_point::max()) return std::nullopt;
+    auto remaining = threadDeadline - DeadlineClock::now();
+    if (remaining <= DeadlineClock::duration::zero()) throw DeadlineExceeded();
+    // Round up: a maxTimeMS of 0 would mean no limit at all
+    return std::chrono::ceil<std::chrono::milliseconds>(remaining);
+}
@@ -0,0 +1,136 @@
+#include "ETag.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+
+// Likes versions are kept per slot, not per entity; ids sharing a slot only cost a spurious 200
+static constexpr size_t kLikesVersionSlots = 4096;
+// Ranking versions likewise per slot of (kind, city)
+static constexpr size_t kRankingVersionSlots = 4096;
+// Remembered user cities. A user whose entry another user took over is not tagged until their
+// next request is served; the entry is direct-mapped, so the table never grows.
+static constexpr size_t kUserCityEntries = 65536;
+// Low bits of a user city entry holding the city hash; the rest hold the user id's hash
+static constexpr uint64_t kCityHashMask = 0xffff;
+
+static std::array<std::atomic<uint64_t>, kRankingVersionSlots> rankingVersions{};
+static std::array<std::atomic<uint64_t>, kLikesVersionSlots> likesVersions{};
+static std::array<std::atomic<uint64_t>, kUserCityEntries> userCities{};
+
+static int64_t maxAgeSeconds() {
+    static const int64_t seconds = getenv("ETAG_MAX_AGE_S") ? std::max(0LL, std::atoll(getenv("ETAG_MAX_AGE_S"))) : 60;
+    return seconds;
+}
+
+static uint64_t processId() {
+    static const uint64_t id = [] {
+        std::random_device random;
+        return (static_cast<uint64_t>(random()) << 32) ^ random();
+    }();
+    return id;
+}
+
+static size_t kindIndex(EntityKind kind) {
+    return kind == EntityKind::User ? 0 : 1;
+}
+
+static std::atomic<uint64_t>& likesSlot(EntityKind kind, const std::string& entityId) {
+    return likesVersions[(std::hash<std::string>{}(entityId) + kindIndex(kind)) % kLikesVersionSlots];
+}
+
+static uint64_t cityHash(const std::string& country, const std::string& city) {
+    return std::hash<std::string>{}(country + '\0' + city) & kCityHashMask;
+}
+
+static std::atomic<uint64_t>& rankingSlot(EntityKind kind, uint64_t city) {
+    return rankingVersions[(city + kindIndex(kind)) % kRankingVersionSlots];
+}
+
+/**
+ * Formats a weak tag from a version: W/"<process>-<window>-<prefix><version>".
+ * @return The tag, or an empty string when ETags are disabled.
+ */
+static std::string makeETag(char prefix, uint64_t version) {
+    int64_t maxAge = maxAgeSeconds();
+    if (maxAge <= 0) return "";
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+    char tag[80];
+    std::snprintf(tag, sizeof(tag), "W/\"%016llx-%llx-%c%llx\"",
+                  static_cast<unsigned long long>(processId()),
+                  static_cast<unsigned long long>(now.count() / maxAge),
+                  prefix, static_cast<unsigned long long>(version));
+    return tag;
+}
+
+void bumpRankingVersion(EntityKind kind, const std::string& country, const std::string& city) {
+    rankingSlot(kind, cityHash(country, city))++;
+}
+
+void rememberUserCity(const std::string& userId, const std::string& country, const std::string& city) {
+    uint64_t user = std::hash<std::string>{}(userId);
+    userCities[user % kUserCityEntries].store((user & ~kCityHashMask) | cityHash(country, city), std::memory_order_relaxed);
+}
+
+void bumpLikesVersion(EntityKind kind, const std::string& entityId) {
+    likesSlot(kind, entityId)++;
+}
+
+std::optional<uint64_t> rankingVersion(EntityKind kind, const std::string& userId) {
+    uint64_t user = std::hash<std::string>{}(userId);
+    uint64_t entry = userCities[user % kUserCityEntries].load(std::memory_order_relaxed);
+    if (entry == 0 || (entry & ~kCityHashMask) != (user & ~kCityHashMask)) return std::nullopt;
+    return rankingSlot(kind, entry & kCityHashMask).load();
+}
+
+uint64_t likesVersion(EntityKind kind, const std::string& entityId) {
+    return likesSlot(kind, entityId).load();
+}
+
+std::string recommendationsETag(EntityKind kind, uint64_t version) {
+    return makeETag(kind == EntityKind::User ? 'u' : 'r', version);
+}
+
+std::string likesETag(EntityKind kind, const std::string& entityId) {
+    return makeETag('l', likesVersion(kind, entityId));
+}
+
+static std::string_view opaqueTag(std::string_view tag) {
+    if (tag.size() >= 2 && tag[0] == 'W' && tag[1] == '/') tag.remove_prefix(2);
+    return tag;
+}
+
+bool etagMatches(std::string_view ifNoneMatch, std::string_view etag) {
+    if (etag.empty()) return false;
+    auto wanted = opaqueTag(etag);
+    while (!ifNoneMatch.empty()) {
+        size_t end = ifNoneMatch.find(',');
+        auto tag = ifNoneMatch.substr(0, end);
+        while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) tag.remove_prefix(1);
+        while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) tag.remove_suffix(1);
+        if (tag == "*" || opaqueTag(tag) == wanted) return true;
+
+        if (end == std::string_view::npos) break;
+        ifNoneMatch.remove_prefix(end + 1);
+    }
+    return false;
+}
+
+bool answerNotModified(const crow::request& req, crow::response& res, const std::string& etag) {
+    if (!etagMatches(req.get_header_value("If-None-Match"), etag)) return false;
+    res.code = 304;
+    setETag(res, etag);
+    res.end();
+    return true;
+}
+
+void setETag(crow::response& res, const std::string& etag) {
+    if (etag.empty() || res.code >= 400) return;
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "private, no-cache");
+}
@@ -0,0 +1,108 @@
+#include "EntityCardCache.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+EntityCardCache::EntityCardCache(size_t capacity, std::chrono::seconds ttl, size_t shardCount)
+    : shardCapacity_(capacity == 0 ? 0 : (capacity + shardCount - 1) / shardCount), ttl_(ttl) {
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::string EntityCardCache::key(EntityKind kind, const std::string& id) {
+    std::string key;
+    key.reserve(id.size() + 1);
+    key += kind == EntityKind::User ? 'u' : 'r';
+    key += id;
+    return key;
+}
+
+EntityCardCache::Shard& EntityCardCache::shardFor(const std::string& key) {
+    return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+EntityCardCache::Fragment EntityCardCache::get(EntityKind kind, const std::string& id) {
+    if (shardCapacity_ == 0) return nullptr;
+
+    auto k = key(kind, id);
+    auto& shard = shardFor(k);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(k);
+    if (it != shard.index.end() && ttl_.count() > 0 && it->second->second->expiresAt <= std::chrono::steady_clock::now()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        it = shard.index.end();
+    }
+    if (it == shard.index.end()) {
+        misses_++;
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    hits_++;
+    return it->second->second;
+}
+
+uint64_t EntityCardCache::version(EntityKind kind, const std::string& id) {
+    if (shardCapacity_ == 0) return 0;
+
+    auto& shard = shardFor(key(kind, id));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.version;
+}
+
+EntityCardCache::Fragment EntityCardCache::put(EntityKind kind, const std::string& id, uint64_t version, std::string json, double popularity) {
+    auto fragment = std::make_shared<const Card>(Card{std::move(json), popularity, std::chrono::steady_clock::now() + ttl_});
+    if (shardCapacity_ == 0) return fragment;
+
+    auto k = key(kind, id);
+    auto& shard = shardFor(k);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // An invalidation since version() means the card may predate the write
+    if (shard.version != version) return fragment;
+
+    auto it = shard.index.find(k);
+    if (it != shard.index.end()) {
+        it->second->second = fragment;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return fragment;
+    }
+
+    shard.lru.emplace_front(k, fragment);
+    shard.index.emplace(std::move(k), shard.lru.begin());
+    if (shard.lru.size() > shardCapacity_) {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+    }
+    return fragment;
+}
+
+void EntityCardCache::invalidate(EntityKind kind, const std::string& id) {
+    if (shardCapacity_ == 0) return;
+
+    auto k = key(kind, id);
+    auto& shard = shardFor(k);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.version++;
+    auto it = shard.index.find(k);
+    if (it != shard.index.end()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+size_t EntityCardCache::size() {
+    size_t total = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->lru.size();
+    }
+    return total;
+}
+
+EntityCardCache& getEntityCardCache() {
+    static EntityCardCache cache(
+        static_cast<size_t>(std::max(0, getenv("ENTITY_CARD_CACHE_SIZE") ? std::atoi(getenv("ENTITY_CARD_CACHE_SIZE")) : 50000)),
+        std::chrono::seconds(std::max(0, getenv("ENTITY_CARD_TTL_SECONDS") ? std::atoi(getenv("ENTITY_CARD_TTL_SECONDS")) : 300)));
+    return cache;
+}
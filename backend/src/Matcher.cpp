@@ -1,70 +1,37 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
-#include <bsoncxx/builder/stream/document.hpp>
-#include <bsoncxx/json.hpp>
-#include <mongocxx/client.hpp>
-#include <mongocxx/instance.hpp>
 #include <crow/crow_all.h>
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
-#include <chrono>
-#include "DBManager.h"
-using bsoncxx::builder::stream::document;
-using bsoncxx::builder::stream::finalize;
-using bsoncxx::builder::stream::open_document;
-using bsoncxx::builder::stream::close_document;
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ETag.h"
+#include "EntityCardCache.h"
+#include "JsonWriter.h"
+#include "Matcher.h"
+#include "Popularity.h"
+#include "PopularityAggregator.h"
+#include "RequestTrace.h"
+#include "Storage.h"
+
+// Maximum number of likers returned by a single /api/likes page
+static constexpr size_t kMaxLikesPageSize = 500;
+
+// Number of recommendations returned by /api/recommend
+static constexpr size_t kMaxRecommendations = 10;
+
+// Reserved response bytes per serialized entity or liker, enough for typical field lengths
+static constexpr size_t kEntityJsonBytes = 384;
+static constexpr size_t kLikerJsonBytes = 96;
 
 // --- Logic Functions ---
 
-/**
- * Normalizes a budget value to a range of 0.0 to 1.0.
- * @param budget The budget value to normalize.
- * @return A normalized budget value between 0.0 and 1.0.
- */
-// TODO: Adjust the min and max budget values
-static double normalizeBudget(double budget) {
-    double minBudget = 500.0;
-    double maxBudget = 100000.0;
-    return (budget - minBudget) / (maxBudget - minBudget); // Result: 0.0 to 1.0
-}
-
-/**
- * Normalizes a popularity score to a range of 0.0 to 1.0.
- * @param popularity The raw popularity score.
- * @param minPopularity The minimum possible popularity score.
- * @param maxPopularity The maximum possible popularity score.
- * @return A normalized popularity score between 0.0 and 1.0.
- */
-static double normalizePopularity(double popularity, double minPopularity = -50, double maxPopularity = 3200) {
-    if (maxPopularity == minPopularity) return 0.0;
-    return std::max(0.0, std::min(1.0, (popularity - minPopularity) / (maxPopularity - minPopularity)));
-}
-
-/**
- * Calculates a popularity score based on various factors.
- * @param received Number of swipes received.
- * @param made Number of swipes made.
- * @param matches Number of matches.
- * @param budget The budget of the entity.
- * @return A calculated popularity score.
- */
-static double calculatePopularity(int received, int made, int matches, double budget) {
-    // Adjust weights for each factor based on their importance
-    // TODO: Train the data based on data to a machine learning model for a popularity score
-    double w_received = 1.0;
-    double w_made = -0.5;
-    double w_matches = 2.0;
-    double w_budget = 0.2;
-    double normalizedBudget = normalizeBudget(budget);
-
-    return w_received * received
-         + w_made * made
-         + w_matches * matches
-         + w_budget * normalizedBudget;
-}
-
-
-
 // TODO: DUE For Deletion as it isn't used currently and is just a helper function
 // bool swipeExists(mongocxx::collection& swipe_collection, const bsoncxx::oid& sourceEntityOid, const bsoncxx::oid& targetEntityOid) {
 //     auto swipe_doc = swipe_collection.find_one(document{} << "sourceEntityId" << sourceEntityOid.to_string() << finalize);
@@ -86,268 +53,321 @@ static double calculatePopularity(int received, int made, int matches, double bu
 
 
 /**
- * Updates the popularity score of an entity (user or room) based on swipes received.
- * @param entity_collection The collection of entities (users or rooms).
- * @param entityOid The OID of the entity to update.
- * @param proximity The proximity score of the entity.
- */
-static void updateEntityPopularity(mongocxx::collection& entity_collection, const bsoncxx::oid& entityOid) {
-    auto maybe_entity = entity_collection.find_one(document{} << "_id" << entityOid << finalize);
-    if (!maybe_entity) {
-        std::cerr << "Entity not found: " << entityOid.to_string() << std::endl;
-        return;
-    }
-
-    auto entity_doc = maybe_entity->view();
-    int currentMade = entity_doc["swipesMade"] ? entity_doc["swipesMade"].get_int32().value : 0;
-    int currentReceived = entity_doc["swipesReceived"] ? entity_doc["swipesReceived"].get_int32().value : 0;
-    int currentMatches = entity_doc["matches"] ? entity_doc["matches"].get_int32().value : 0;
-    std::string budgetStr = entity_doc["budget"] && entity_doc["budget"].type() == bsoncxx::type::k_string
-        ? std::string(entity_doc["budget"].get_string().value)
-        : "0.0";
-    double budget = 0.0;
-    try {
-        // Remove $ if present
-        if (!budgetStr.empty() && budgetStr[0] == '$') budgetStr = budgetStr.substr(1);
-        budget = std::stod(budgetStr);
-    } catch (...) {
-        budget = 0.0;
-    }
-
-    int newReceived = currentReceived + 1;
-    double newPopularity = calculatePopularity(newReceived, currentMade, currentMatches, budget);
-
-    entity_collection.update_one(document{} << "_id" << entityOid << finalize,
-        document{}
-        << "$set" << open_document
-        << "swipesReceived" << newReceived
-        << "popularity" << newPopularity
-        << close_document
-        << finalize);
-}
-
-/**
- * Updates the matches count for both entities involved in a swipe.
- * @param source_collection The collection of the source entity (user or room).
- * @param target_collection The collection of the target entity (user or room).
- * @param sourceEntityOid The OID of the source entity.
- * @param targetEntityOid The OID of the target entity.
+ * Records a match for both entities involved in a swipe.
+ * The counters are folded by the popularity aggregator and written on its next flush.
+ * @param targetKind Whether the target entity is a user or a room.
+ * @param sourceId The ID of the source entity.
+ * @param targetId The ID of the target entity.
  */
-static void updateEntityMatches(mongocxx::collection& source_collection,
-                         mongocxx::collection& target_collection,
-                         const bsoncxx::oid& sourceEntityOid,
-                         const bsoncxx::oid& targetEntityOid) {
-    source_collection.update_one(
-        document{} << "_id" << sourceEntityOid << finalize,
-        document{} << "$inc" << open_document << "matches" << 1 << close_document << finalize);
-
-    target_collection.update_one(
-        document{} << "_id" << targetEntityOid << finalize,
-        document{} << "$inc" << open_document << "matches" << 1 << close_document << finalize);
+static void updateEntityMatches(EntityKind targetKind,
+                         const std::string& sourceId,
+                         const std::string& targetId) {
+    auto& aggregator = getPopularityAggregator();
+    aggregator.recordMatch(EntityKind::User, sourceId);
+    aggregator.recordMatch(targetKind, targetId);
 }
 
 /**
  * Handles the like action for an entity (user or room).
- * @param source_collection The collection of the source entity (user or room).
- * @param target_collection The collection of the target entity (user or room).
- * @param swipe_collection The collection for storing swipe actions.
- * @param sourceEntityOid The OID of the source entity.
- * @param targetEntityOid The OID of the target entity.
+ * @param storage The store holding the swipes.
+ * @param targetKind Whether the target entity is a user or a room.
+ * @param sourceId The ID of the source entity.
+ * @param targetId The ID of the target entity.
  */
-static void handleEntityLike(mongocxx::collection& source_collection,
-                      mongocxx::collection& target_collection,
-                      mongocxx::collection& swipe_collection,
-                      const bsoncxx::oid& sourceEntityOid,
-                      const bsoncxx::oid& targetEntityOid) {
+static void handleEntityLike(Storage& storage,
+                      EntityKind targetKind,
+                      const std::string& sourceId,
+                      const std::string& targetId) {
 
-    updateEntityPopularity(target_collection, targetEntityOid);
+    getPopularityAggregator().recordSwipeReceived(targetKind, targetId);
 
     // Check for mutual like
-    auto filter = document{}
-                  << "sourceEntityId" << targetEntityOid.to_string()
-                  << "targetEntityId" << sourceEntityOid.to_string()
-                  << finalize;
-    if (swipe_collection.find_one(filter.view())) {
-        updateEntityMatches(source_collection, target_collection, sourceEntityOid, targetEntityOid);
+    if (storage.hasSwiped(targetKind, targetId, sourceId)) {
+        updateEntityMatches(targetKind, sourceId, targetId);
     }
     
 }
 
+static constexpr const char* kInvalidIdError = "Invalid sourceId or targetId.";
+
 /**
- * Handles the swipe action between two entities (users or rooms).
- * @param source_collection The collection of the source entity (user or room).
- * @param swipe_collection The collection for storing swipe actions.
- * @param sourceEntityOid The OID of the source entity.
- * @param targetEntityOid The OID of the target entity.
+ * Parses the `type` parameter of the API.
+ * @return The entity kind, or std::nullopt if the type is neither "roommate" nor "room".
  */
-static void handleEntitySwipe(mongocxx::collection& source_collection,
-                        mongocxx::collection& swipe_collection,
-                        const bsoncxx::oid& sourceEntityOid,
-                        const bsoncxx::oid& targetEntityOid) {
-
-    mongocxx::options::update opts;
-    opts.upsert(true);
-    swipe_collection.update_one(
-        document{} << "sourceEntityId" << sourceEntityOid.to_string() << finalize,
-        document{}
-            << "$setOnInsert" << open_document
-                << "sourceEntityId" << sourceEntityOid.to_string()
-            << close_document
-            << "$addToSet" << open_document
-                << "targetEntityId" << targetEntityOid.to_string()
-            << close_document
-            << finalize,
-        opts);
-
-    source_collection.update_one(
-        document{} << "_id" << sourceEntityOid << finalize,
-        document{}
-            << "$inc" << open_document
-                << "swipesMade" << 1
-            << close_document
-            << finalize);
+std::optional<EntityKind> parseEntityType(const std::string& type) {
+    if (type == "roommate") return EntityKind::User;
+    if (type == "room") return EntityKind::Room;
+    return std::nullopt;
+}
+
+// Ids are ObjectIds in hex form regardless of the storage backend
+static bool isEntityId(const std::string& id) {
+    return id.size() == 24 && id.find_first_not_of("0123456789abcdef") == std::string::npos;
 }
 
 
+
 // --- High-level API Functions ---
+/**
+ * Serializes the card shown for an entity in recommendations.
+ */
+static std::string entityCardJson(EntityKind kind, const EntityRecord& record) {
+    JsonWriter json(kEntityJsonBytes);
+    json.beginObject();
+    json.field("id", record.id);
+
+    if (kind == EntityKind::User) {
+        json.field("username", record.username);
+        json.field("firstName", record.firstName);
+        json.field("lastName", record.lastName);
+    }
+
+    json.field("address", record.address);
+    json.field("address_line", record.address_line);
+    json.field("city", record.city);
+    json.field("state", record.state);
+    json.field("country", record.country);
+    json.field("zipcode", record.zipcode);
+    json.field("phone", record.phone);
+    json.field("budget", record.budget);
+    json.field("popularity", normalizePopularity(record.popularity));
+    json.endObject();
+    return json.release();
+}
+
 /**
  * Fetches recommended roommates or rooms for the current user based on their location.
+ * Candidates are ranked on a projection of the city; the cards of the top ones come from the
+ * entity card cache and only misses are read in full and serialized.
  * @param currentUserId The ID of the current user.
  * @param type The type of recommendation to fetch ("roommate" or "room").
  * @return A JSON object containing recommended roommates or rooms.
  */
-crow::json::wvalue getRecommendations(const std::string& currentUserId, const std::string& type) {
+std::string getRecommendations(const std::string& currentUserId, const std::string& type) {
 
-    if (type != "roommate" && type != "room") {
-        return crow::json::wvalue({{"error", "Invalid type parameter. Use 'roommate' or 'room'."}});
+    auto kind = parseEntityType(type);
+    if (!kind) {
+        return jsonError(kInvalidTypeError);
     }
 
-    crow::json::wvalue result;
-    auto& db = getDbManager();
-    auto userColl = db.getUserCollection();
-    auto roomColl = db.getRoomCollection();
-    auto& entityColl = (type == "roommate") ? userColl : roomColl;
-
-    auto currentDoc = userColl.find_one(
-        document{} << "_id" << bsoncxx::oid(currentUserId) << finalize
-    );
-    if (!currentDoc) {
-        return { { "error", "Current user not found." } };
-    }
+    auto& storage = getStorage();
 
-    auto current_view = currentDoc->view();
-    std::string country = std::string(current_view["country"].get_string().value);
-    std::string city    = std::string(current_view["city"].get_string().value);
-    auto cursor = entityColl.find(document{} << "country" << country << "city" << city << finalize);
-    
-    std::vector<std::pair<double, crow::json::wvalue>> scored;
+    std::vector<EntityRank> candidates;
+    {
+        StageTimer timer(Stage::DbFetch);
+        auto current = storage.findEntity(EntityKind::User, currentUserId);
+        if (!current) {
+            return jsonError("Current user not found.");
+        }
+        // Later polls of this user are tagged with the ranking version of the city
+        rememberUserCity(currentUserId, current->country, current->city);
+        candidates = storage.rankEntitiesInCity(*kind, current->country, current->city);
+    }
 
-    for (auto&& doc : cursor) {
-        try {
-            if (type == "room") {
-                if (doc["ownerId"] && doc["ownerId"].type() == bsoncxx::type::k_oid) {
-                    auto ownerId = doc["ownerId"].get_oid().value;
-                    if (ownerId.to_string() == currentUserId) {
-                        continue;
-                    }
+    std::vector<std::pair<double, size_t>> scored;
+    scored.reserve(candidates.size());
+    {
+        StageTimer timer(Stage::Scoring);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const auto& candidate = candidates[i];
+            if (*kind == EntityKind::Room) {
+                if (candidate.ownerId == currentUserId) {
+                    continue;
                 }
             } else {
-                if (doc["_id"].type() == bsoncxx::type::k_oid &&
-                    doc["_id"].get_oid().value.to_string() == currentUserId)
+                if (candidate.id == currentUserId)
                     continue;
             }
-            
-            double popularity = doc["popularity"] ? doc["popularity"].get_double().value : 0.0;
-            double norm_Pop = normalizePopularity(popularity);
+            if (candidate.id.empty()) continue;
 
-            crow::json::wvalue entity;
-            entity["id"] = doc["_id"].get_oid().value.to_string();
+            scored.emplace_back(normalizePopularity(candidate.popularity), i);
+        }
+    }
 
-            if (type == "roommate") {
-                entity["username"]  = doc["username"]  ? std::string(doc["username"] .get_string().value) : "";
-                entity["firstName"] = doc["firstName"] ? std::string(doc["firstName"].get_string().value) : "";
-                entity["lastName"]  = doc["lastName"]  ? std::string(doc["lastName"] .get_string().value) : "";
-            }
+    size_t count = std::min(scored.size(), kMaxRecommendations);
+    {
+        StageTimer timer(Stage::TopK);
+        std::partial_sort(scored.begin(), scored.begin() + count, scored.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+    }
 
-            entity["address"]      = doc["address"]      ? std::string(doc["address"]     .get_string().value) : "";
-            entity["address_line"] = doc["address_line"] ? std::string(doc["address_line"].get_string().value) : "";
-            entity["city"]         = doc["city"]         ? std::string(doc["city"]        .get_string().value) : "";
-            entity["state"]        = doc["state"]        ? std::string(doc["state"]       .get_string().value) : "";
-            entity["country"]      = doc["country"]      ? std::string(doc["country"]     .get_string().value) : ""; 
-            entity["zipcode"]      = doc["zipcode"]      ? std::string(doc["zipcode"]     .get_string().value) : "";
-            entity["phone"]        = doc["phone"]        ? std::string(doc["phone"]       .get_string().value) : "";
-            entity["budget"]       = doc["budget"]       ? std::string(doc["budget"]      .get_string().value) : "0.0";
-            entity["popularity"]   = norm_Pop;
-
-            scored.emplace_back(norm_Pop, std::move(entity));
-        } catch (const std::exception& e) {
-            std::cerr << "Exception for doc: " << bsoncxx::to_json(doc)
-                        << "\nError: " << e.what() << std::endl;
-            result["error"] = "Backend error: " + std::string(e.what());
+    // Cached cards first; the versions guard the misses against a concurrent write
+    auto& cache = getEntityCardCache();
+    std::vector<EntityCardCache::Fragment> cards(count);
+    std::vector<std::string> missingIds;
+    std::unordered_map<std::string, std::pair<size_t, uint64_t>> missing;
+    for (size_t i = 0; i < count; ++i) {
+        const auto& candidate = candidates[scored[i].second];
+        const auto& id = candidate.id;
+        cards[i] = cache.get(*kind, id);
+        if (cards[i] && cards[i]->popularity != candidate.popularity) cards[i] = nullptr;
+        if (!cards[i]) {
+            missing.emplace(id, std::make_pair(i, cache.version(*kind, id)));
+            missingIds.push_back(id);
         }
     }
+    std::vector<EntityRecord> records;
+    if (!missingIds.empty()) {
+        StageTimer timer(Stage::DbFetch);
+        records = storage.findEntities(*kind, missingIds);
+    }
 
-    std::sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) {
-        return a.first > b.first;
-    });
+    StageTimer timer(Stage::Serialize);
+    for (auto& record : records) {
+        auto it = missing.find(record.id);
+        if (it == missing.end()) continue;
+        auto [index, version] = it->second;
+        cards[index] = cache.put(*kind, record.id, version, entityCardJson(*kind, record), record.popularity);
+    }
 
-    result["entity"] = crow::json::wvalue::list();
-    for (size_t i = 0; i < std::min(scored.size(), size_t(10)); ++i) {
-        result["entity"][i] = std::move(scored[i].second);
+    JsonWriter json(32 + count * kEntityJsonBytes);
+    json.beginObject().key("entity").beginArray();
+    for (const auto& card : cards) {
+        // Entities deleted since the ranking scan have no card
+        if (card) json.raw(card->json);
     }
+    json.endArray().endObject();
 
-    return result;
+    return json.release();
 }
 
 /**
- * Fetches users who liked a specific entity (user or room).
- * @param entityId The ID of the entity to check likes for.
- * @param type The type of entity ("roommate" or "room").
- * @return A JSON object containing users who liked the entity.
+ * Fetches a user's full profile.
+ * @param userId The ID of the user.
+ * @return A JSON object with the user's profile and counters.
  */
-crow::json::wvalue getUserWhoLikedEntity(const std::string& entityId, const std::string& type) {
-    if (type != "roommate" && type != "room") {
-        return crow::json::wvalue({{"error", "Invalid type parameter. Use 'roommate' or 'room'."}});
+std::string fetchUserInfo(const std::string& userId) {
+    try {
+        auto user = getStorage().findEntity(EntityKind::User, userId);
+        if (!user) {
+            return jsonError("User not found.");
+        }
+
+        JsonWriter json(kEntityJsonBytes);
+        json.beginObject();
+        json.field("id", userId);
+        json.field("username", user->username);
+        json.field("email", user->email);
+        json.field("phone", user->phone);
+        json.field("gender", user->gender);
+        json.field("address", user->address);
+        json.field("address_line", user->address_line);
+        json.field("zipcode", user->zipcode);
+        json.field("city", user->city);
+        json.field("state", user->state);
+        json.field("country", user->country);
+        json.field("budget", user->budget);
+        json.field("popularity", user->popularity);
+        json.field("matches", user->matches);
+        json.field("swipesMade", user->swipesMade);
+        json.field("swipesReceived", user->swipesReceived);
+        json.endObject();
+        return json.release();
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error fetching user info: " << e.what() << std::endl;
+        return jsonError("Backend error: " + std::string(e.what()));
     }
+}
 
-    auto& dbManager = getDbManager();
-    auto swipe_collection = (type == "roommate") ? dbManager.getUserSwipeCollection() : dbManager.getRoomSwipeCollection();
-    auto user_collection = dbManager.getUserCollection();
+/**
+ * Fetches one page of users who liked an entity.
+ * @throws std::invalid_argument if the type or cursor is invalid.
+ */
+static LikersPage fetchLikesPage(const std::string& entityId, const std::string& type, const std::string& cursor, size_t limit) {
+    auto kind = parseEntityType(type);
+    if (!kind) {
+        throw std::invalid_argument(kInvalidTypeError);
+    }
+    limit = std::max<size_t>(1, std::min(limit, kMaxLikesPageSize));
+    return getStorage().findLikers(*kind, entityId, cursor, limit);
+}
 
-    crow::json::wvalue result;
-    result["users"] = crow::json::wvalue::list();
+static void writeLiker(JsonWriter& json, const LikerRecord& liker) {
+    json.beginObject();
+    json.field("id", liker.id);
+    json.field("username", liker.username);
+    json.field("popularity", liker.popularity);
+    if (liker.matches) json.field("matches", *liker.matches);
+    json.endObject();
+}
 
+/**
+ * Fetches a page of users who liked a specific entity (user or room).
+ * @param entityId The ID of the entity to check likes for.
+ * @param type The type of entity ("roommate" or "room").
+ * @param cursor The `nextCursor` returned by the previous page, or empty for the first page.
+ * @param limit The maximum number of users to return, capped at kMaxLikesPageSize.
+ * @return A JSON object containing users who liked the entity and, if there are more, a `nextCursor`.
+ * @throws DeadlineExceeded or a storage error if the page could not be read.
+ */
+std::string getUserWhoLikedEntity(const std::string& entityId, const std::string& type, const std::string& cursor, size_t limit) {
     try {
-        // Find all swipe documents where the entity is the target
-        auto cursor = swipe_collection.find(
-            document{} << "targetEntityId" << entityId << finalize
-        );
-
-        for (auto&& swipe_doc : cursor) {
-            std::string userId = std::string(swipe_doc["sourceEntityId"].get_string().value);
-
-            // Fetch user details from the user collection
-            auto user_doc = user_collection.find_one(document{} << "_id" << bsoncxx::oid(userId) << finalize);
-            if (user_doc) {
-                auto user_view = user_doc->view();
-                crow::json::wvalue user;
-                user["id"] = userId;
-                user["username"] = user_view["username"] ? std::string(user_view["username"].get_string().value) : "";
-                user["popularity"] = user_view["popularity"] ? user_view["popularity"].get_double().value : 0.0;
-                user["matches"] = user_view["matches"] ? user_view["matches"].get_int32().value : 0;
-
-                result["users"][result["users"].size()] = std::move(user);
-            }
+        LikersPage page;
+        {
+            StageTimer timer(Stage::DbFetch);
+            page = fetchLikesPage(entityId, type, cursor, limit);
+        }
+
+        StageTimer timer(Stage::Serialize);
+        JsonWriter json(64 + page.nextCursor.size() + page.likers.size() * kLikerJsonBytes);
+        json.beginObject().key("users").beginArray();
+        for (const auto& liker : page.likers) {
+            writeLiker(json, liker);
+        }
+        json.endArray();
+        if (!page.nextCursor.empty()) {
+            json.field("nextCursor", page.nextCursor);
         }
+        json.endObject();
+        return json.release();
+    } catch (const std::invalid_argument& e) {
+        return jsonError(e.what());
     } catch (const std::exception& e) {
+        // Left to the caller, so a storage failure or deadline is not answered as a page
         std::cerr << "Error fetching users who liked the entity: " << e.what()
                     << std::endl;
-        result["error"] = "Backend error: " + std::string(e.what());
+        throw;
     }
-    return result;
 }
 
+bool LikesStream::next(std::string& out) {
+    if (!started_) {
+        out += "{\"users\":[";
+        started_ = true;
+    }
+
+    try {
+        auto page = fetchLikesPage(entityId_, type_, cursor_, kMaxLikesPageSize);
+        out.reserve(out.size() + page.likers.size() * kLikerJsonBytes);
+        for (const auto& liker : page.likers) {
+            if (emitted_++) out += ',';
+            JsonWriter json(out);
+            writeLiker(json, liker);
+        }
+        if (!page.nextCursor.empty()) {
+            cursor_ = std::move(page.nextCursor);
+            return true;
+        }
+        out += "]}";
+    } catch (const std::exception& e) {
+        std::cerr << "Error streaming users who liked the entity: " << e.what() << std::endl;
+        fail(out, e.what());
+    }
+    return false;
+}
 
+void LikesStream::fail(std::string& out, const std::string& error) {
+    if (!started_) {
+        out += "{\"users\":[";
+        started_ = true;
+    }
+    out += "],";
+    JsonWriter json(out);
+    json.key("error").value(error);
+    out += '}';
+}
 
 /**
  * Processes a swipe action for a room.
@@ -358,21 +378,143 @@ crow::json::wvalue getUserWhoLikedEntity(const std::string& entityId, const std:
  * @return A JSON object indicating the status of the swipe action.
  */
 crow::json::wvalue processSwipe(const std::string& sourceId, const std::string& targetId, const std::string& type, bool isLike) {
-    auto& db       = getDbManager();
-    auto userColl = db.getUserCollection();
-    bsoncxx::oid srcOid(sourceId);
-    bsoncxx::oid tgtOid(targetId);
+    auto kind = parseEntityType(type);
+    if (!kind) {
+        return crow::json::wvalue({{"error", kInvalidTypeError}});
+    }
+    if (!isEntityId(sourceId) || !isEntityId(targetId)) {
+        return crow::json::wvalue({{"error", kInvalidIdError}});
+    }
+
+    StageTimer timer(Stage::DbFetch);
+    auto& storage = getStorage();
+    storage.recordSwipe(*kind, sourceId, targetId);
+    getPopularityAggregator().recordSwipeMade(EntityKind::User, sourceId);
 
-    if (type != "roommate" && type != "room") {
-        return crow::json::wvalue({{"error", "Invalid type parameter. Use 'roommate' or 'room'."}});
+    if (isLike) {
+        handleEntityLike(storage, *kind, sourceId, targetId);
+        // Recorded for every like, not only new swipes, so retrying a like whose inbox push failed lists it
+        if (storage.recordLike(*kind, sourceId, targetId)) {
+            bumpLikesVersion(*kind, targetId);
+        }
     }
 
-    auto swipeColl  = (type == "roommate" ? db.getUserSwipeCollection() : db.getRoomSwipeCollection());
-    auto targetColl = (type == "roommate" ? userColl : db.getRoomCollection());
+    return crow::json::wvalue({{"status", "Room swipe processed"}});
+}
 
-    handleEntitySwipe(userColl, swipeColl, srcOid, tgtOid);
+/**
+ * Processes a batch of swipes with the same effects as one processSwipe() call per swipe.
+ * Swipes are grouped by source and kind, and each group is written with the batched Storage
+ * calls, so a batch from one user costs a handful of round trips rather than a few per swipe.
+ * A repeat of an earlier (type, sourceId, targetId) in the same batch is reported as a
+ * duplicate and skipped. A storage error fails only the swipes of its group. If it happens after
+ * the group's swipes were written, their results say so with "status": "recorded"; retrying them
+ * is safe and completes the match check and the likes listing.
+ * @param swipes The swipes, in the order the client made them.
+ * @return {"results": [...], "processed": n, "duplicates": n, "failed": n}, with one result per
+ *         swipe in order: {"status": "processed", "new": bool, "match": bool}, {"status": "duplicate"},
+ *         {"status": "recorded", "new": bool, "error": ...} or {"error": ...}.
+ */
+std::string processSwipes(const std::vector<SwipeItem>& swipes) {
+    struct Outcome {
+        std::string error;
+        bool duplicate = false;
+        bool recorded = false;  // The swipe was written, even if a later step failed
+        bool isNew = false;
+        bool match = false;
+    };
+    struct Group {
+        EntityKind kind;
+        std::string sourceId;
+        std::vector<size_t> items;
+    };
+
+    std::vector<Outcome> outcomes(swipes.size());
+    std::vector<Group> groups;
+    std::unordered_map<std::string, size_t> groupIndex;
+    std::unordered_set<std::string> seen;
+
+    for (size_t i = 0; i < swipes.size(); ++i) {
+        const auto& swipe = swipes[i];
+        if (swipe.malformed) { outcomes[i].error = "Invalid swipe."; continue; }
+        auto kind = parseEntityType(swipe.type);
+        if (!kind) { outcomes[i].error = kInvalidTypeError; continue; }
+        if (!isEntityId(swipe.sourceId) || !isEntityId(swipe.targetId)) { outcomes[i].error = kInvalidIdError; continue; }
+
+        std::string groupKey = (*kind == EntityKind::User ? 'u' : 'r') + swipe.sourceId;
+        if (!seen.insert(groupKey + swipe.targetId).second) { outcomes[i].duplicate = true; continue; }
+        auto [it, inserted] = groupIndex.try_emplace(groupKey, groups.size());
+        if (inserted) groups.push_back({*kind, swipe.sourceId, {}});
+        groups[it->second].items.push_back(i);
+    }
 
-    if (isLike) handleEntityLike(userColl, targetColl, swipeColl, srcOid, tgtOid);   
+    auto& storage = getStorage();
+    auto& aggregator = getPopularityAggregator();
+    StageTimer dbTimer(Stage::DbFetch);
+    for (const auto& group : groups) {
+        std::vector<std::string> targets, likedTargets;
+        targets.reserve(group.items.size());
+        for (size_t i : group.items) targets.push_back(swipes[i].targetId);
 
-    return crow::json::wvalue({{"status", "Room swipe processed"}});
+        try {
+            auto isNew = storage.recordSwipes(group.kind, group.sourceId, targets);
+            for (size_t n = 0; n < group.items.size(); ++n) {
+                outcomes[group.items[n]].recorded = true;
+                outcomes[group.items[n]].isNew = isNew[n];
+                aggregator.recordSwipeMade(EntityKind::User, group.sourceId);
+                if (!swipes[group.items[n]].isLike) continue;
+                aggregator.recordSwipeReceived(group.kind, targets[n]);
+                likedTargets.push_back(targets[n]);
+            }
+
+            // Mutual likes: the liked targets that have swiped on the source
+            auto swipers = storage.findSwipersOf(group.kind, likedTargets, group.sourceId);
+            std::unordered_set<std::string> mutual(swipers.begin(), swipers.end());
+            for (size_t n = 0; n < group.items.size(); ++n) {
+                if (!swipes[group.items[n]].isLike || !mutual.count(targets[n])) continue;
+                updateEntityMatches(group.kind, group.sourceId, targets[n]);
+                outcomes[group.items[n]].match = true;
+            }
+
+            // Every like, not only new swipes, so a retry lists likes whose inbox push failed
+            auto listed = storage.recordLikes(group.kind, group.sourceId, likedTargets);
+            for (size_t n = 0; n < likedTargets.size(); ++n) {
+                if (listed[n]) bumpLikesVersion(group.kind, likedTargets[n]);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error processing swipes of " << group.sourceId << ": " << e.what() << std::endl;
+            for (size_t i : group.items) outcomes[i].error = e.what();
+        }
+    }
+    dbTimer.stop();
+
+    StageTimer serializeTimer(Stage::Serialize);
+    size_t failed = 0, duplicates = 0;
+    JsonWriter json(64 + swipes.size() * 48);
+    json.beginObject().key("results").beginArray();
+    for (const auto& outcome : outcomes) {
+        json.beginObject();
+        if (!outcome.error.empty()) {
+            if (outcome.recorded) {
+                json.field("status", "recorded");
+                json.field("new", outcome.isNew);
+            }
+            json.field("error", outcome.error);
+            failed++;
+        } else if (outcome.duplicate) {
+            json.field("status", "duplicate");
+            duplicates++;
+        } else {
+            json.field("status", "processed");
+            json.field("new", outcome.isNew);
+            json.field("match", outcome.match);
+        }
+        json.endObject();
+    }
+    json.endArray();
+    json.field("processed", swipes.size() - failed - duplicates);
+    json.field("duplicates", duplicates);
+    json.field("failed", failed);
+    json.endObject();
+    return json.release();
 }
@@ -0,0 +1,296 @@
+#include "MemoryStorage.h"
+#include "Popularity.h"
+
+#include <crow/crow_all.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+static std::string cityKey(const std::string& country, const std::string& city) {
+    std::string key;
+    key.reserve(country.size() + 1 + city.size());
+    key += country;
+    key += '\0';
+    key += city;
+    return key;
+}
+
+// --- Fixture ---
+
+/// An id given either as a plain string or as extended JSON {"$oid": "..."}.
+static std::string fixtureId(const crow::json::rvalue& value) {
+    if (value.t() == crow::json::type::String) return value.s();
+    if (value.t() == crow::json::type::Object && value.has("$oid")) return value["$oid"].s();
+    return "";
+}
+
+static std::string fixtureString(const crow::json::rvalue& doc, const char* key, const std::string& fallback = "") {
+    if (!doc.has(key) || doc[key].t() != crow::json::type::String) return fallback;
+    return doc[key].s();
+}
+
+static double fixtureNumber(const crow::json::rvalue& doc, const char* key) {
+    if (!doc.has(key) || doc[key].t() != crow::json::type::Number) return 0.0;
+    return doc[key].d();
+}
+
+static EntityRecord fixtureEntity(const crow::json::rvalue& doc) {
+    EntityRecord record;
+    if (doc.has("_id")) record.id = fixtureId(doc["_id"]);
+    if (doc.has("ownerId")) record.ownerId = fixtureId(doc["ownerId"]);
+    record.username =       fixtureString(doc, "username");
+    record.firstName =      fixtureString(doc, "firstName");
+    record.lastName =       fixtureString(doc, "lastName");
+    record.email =          fixtureString(doc, "email");
+    record.phone =          fixtureString(doc, "phone");
+    record.gender =         fixtureString(doc, "gender");
+    record.address =        fixtureString(doc, "address");
+    record.address_line =   fixtureString(doc, "address_line");
+    record.city =           fixtureString(doc, "city");
+    record.state =          fixtureString(doc, "state");
+    record.country =        fixtureString(doc, "country");
+    record.zipcode =        fixtureString(doc, "zipcode");
+    record.budget =         fixtureString(doc, "budget", "0.0");
+    record.popularity =     fixtureNumber(doc, "popularity");
+    record.matches =        static_cast<int>(fixtureNumber(doc, "matches"));
+    record.swipesMade =     static_cast<int>(fixtureNumber(doc, "swipesMade"));
+    record.swipesReceived = static_cast<int>(fixtureNumber(doc, "swipesReceived"));
+    return record;
+}
+
+void MemoryStorage::loadFixture(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open fixture " + path);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+
+    auto fixture = crow::json::load(buffer.str());
+    if (!fixture || fixture.t() != crow::json::type::Object) {
+        throw std::runtime_error("Fixture " + path + " is not a JSON object");
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto loadEntities = [&](const char* key, EntityKind kind) {
+        if (!fixture.has(key)) return;
+        for (const auto& doc : fixture[key]) {
+            auto record = fixtureEntity(doc);
+            if (!record.id.empty()) putEntityLocked(kind, std::move(record));
+        }
+    };
+    auto loadSwipes = [&](const char* key, EntityKind kind) {
+        if (!fixture.has(key)) return;
+        for (const auto& doc : fixture[key]) {
+            if (!doc.has("sourceEntityId") || !doc.has("targetEntityId")) continue;
+            std::string sourceId = fixtureId(doc["sourceEntityId"]);
+            for (const auto& target : doc["targetEntityId"]) {
+                std::string targetId = fixtureId(target);
+                if (recordSwipeLocked(kind, sourceId, targetId)) {
+                    recordLikeLocked(kind, sourceId, targetId);
+                }
+            }
+        }
+    };
+    loadEntities("users", EntityKind::User);
+    loadEntities("rooms", EntityKind::Room);
+    loadSwipes("user_swipes", EntityKind::User);
+    loadSwipes("room_swipes", EntityKind::Room);
+
+    std::cerr << "Loaded fixture " << path << ": " << users_.byId.size() << " users, "
+              << rooms_.byId.size() << " rooms" << std::endl;
+}
+
+// --- Entities ---
+
+void MemoryStorage::putEntity(EntityKind kind, EntityRecord record) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    putEntityLocked(kind, std::move(record));
+}
+
+void MemoryStorage::putEntityLocked(EntityKind kind, EntityRecord record) {
+    auto& table = entities(kind);
+    auto existing = table.byId.find(record.id);
+    if (existing != table.byId.end()) {
+        auto& ids = table.byCity[cityKey(existing->second.country, existing->second.city)];
+        ids.erase(std::remove(ids.begin(), ids.end(), record.id), ids.end());
+    }
+    table.byCity[cityKey(record.country, record.city)].push_back(record.id);
+    std::string id = record.id;
+    table.byId[id] = std::move(record);
+}
+
+std::optional<EntityRecord> MemoryStorage::findEntity(EntityKind kind, const std::string& id) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto& table = entities(kind);
+    auto it = table.byId.find(id);
+    if (it == table.byId.end()) return std::nullopt;
+    return it->second;
+}
+
+std::vector<EntityRecord> MemoryStorage::findEntities(EntityKind kind, const std::vector<std::string>& ids) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto& table = entities(kind);
+    std::vector<EntityRecord> found;
+    found.reserve(ids.size());
+    for (const auto& id : ids) {
+        auto it = table.byId.find(id);
+        if (it != table.byId.end()) found.push_back(it->second);
+    }
+    return found;
+}
+
+std::vector<EntityRank> MemoryStorage::rankEntitiesInCity(EntityKind kind, const std::string& country, const std::string& city) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto& table = entities(kind);
+    std::vector<EntityRank> found;
+    auto ids = table.byCity.find(cityKey(country, city));
+    if (ids == table.byCity.end()) return found;
+
+    found.reserve(ids->second.size());
+    for (const auto& id : ids->second) {
+        const auto& record = table.byId.at(id);
+        found.push_back({record.id, record.ownerId, record.popularity});
+    }
+    return found;
+}
+
+std::vector<Profile> MemoryStorage::loadProfiles() {
+    std::vector<Profile> profiles;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        profiles.reserve(users_.byId.size());
+        for (const auto& [id, user] : users_.byId) {
+            Profile profile;
+            profile.id =        id;
+            profile.city =      user.city;
+            profile.state =     user.state;
+            profile.country =   user.country;
+            profile.zipcode =   user.zipcode;
+            profile.budget =    user.budget;
+            profiles.push_back(std::move(profile));
+        }
+    }
+    // Tokenize outside the lock so writers are not held up by the regex work
+    for (auto& profile : profiles) {
+        tokenizeProfile(profile);
+    }
+    return profiles;
+}
+
+// --- Swipes ---
+
+bool MemoryStorage::recordSwipeLocked(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) {
+    return swipes(targetKind).targetsBySource[sourceId].insert(targetId).second;
+}
+
+bool MemoryStorage::recordSwipe(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return recordSwipeLocked(targetKind, sourceId, targetId);
+}
+
+bool MemoryStorage::hasSwiped(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto& table = swipes(targetKind);
+    auto it = table.targetsBySource.find(sourceId);
+    return it != table.targetsBySource.end() && it->second.count(targetId) > 0;
+}
+
+bool MemoryStorage::recordLikeLocked(EntityKind targetKind, const std::string& likerId, const std::string& targetId) {
+    auto& table = swipes(targetKind);
+    if (!table.likerSetByTarget[targetId].insert(likerId).second) return false;
+    table.likersByTarget[targetId].push_back(likerId);
+    return true;
+}
+
+bool MemoryStorage::recordLike(EntityKind targetKind, const std::string& likerId, const std::string& targetId) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return recordLikeLocked(targetKind, likerId, targetId);
+}
+
+std::vector<bool> MemoryStorage::recordSwipes(EntityKind targetKind, const std::string& sourceId, const std::vector<std::string>& targetIds) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::vector<bool> isNew;
+    isNew.reserve(targetIds.size());
+    for (const auto& targetId : targetIds) {
+        isNew.push_back(recordSwipeLocked(targetKind, sourceId, targetId));
+    }
+    return isNew;
+}
+
+std::vector<bool> MemoryStorage::recordLikes(EntityKind targetKind, const std::string& likerId, const std::vector<std::string>& targetIds) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::vector<bool> listed;
+    listed.reserve(targetIds.size());
+    for (const auto& targetId : targetIds) {
+        listed.push_back(recordLikeLocked(targetKind, likerId, targetId));
+    }
+    return listed;
+}
+
+/**
+ * Pages through the entity's likers newest first. The cursor is the index of the next liker
+ * to emit; likes are only ever appended, so indexes stay valid between pages.
+ */
+LikersPage MemoryStorage::findLikers(EntityKind kind, const std::string& entityId, const std::string& cursor, size_t limit) {
+    long next = -1;
+    if (!cursor.empty()) {
+        std::string raw = crow::utility::base64decode(cursor, cursor.size());
+        if (raw.size() < 3 || raw.compare(0, 2, "m:") != 0 ||
+            raw.find_first_not_of("0123456789", 2) != std::string::npos || raw.size() > 2 + 18) {
+            throw std::invalid_argument("Invalid cursor.");
+        }
+        next = std::stol(raw.substr(2));
+    }
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    LikersPage page;
+    auto& likers = swipes(kind).likersByTarget;
+    auto it = likers.find(entityId);
+    if (it == likers.end()) return page;
+
+    const auto& likerIds = it->second;
+    long start = static_cast<long>(likerIds.size()) - 1;
+    if (next >= 0) start = std::min(start, next);
+
+    for (long i = start; i >= 0; --i) {
+        if (page.likers.size() == limit) {
+            std::string raw = "m:" + std::to_string(i);
+            page.nextCursor = crow::utility::base64encode_urlsafe(raw, raw.size());
+            break;
+        }
+        auto user = users_.byId.find(likerIds[i]);
+        if (user == users_.byId.end()) continue;
+
+        LikerRecord liker;
+        liker.id = user->first;
+        liker.username = user->second.username;
+        liker.popularity = user->second.popularity;
+        liker.matches = user->second.matches;
+        page.likers.push_back(std::move(liker));
+    }
+    return page;
+}
+
+// --- Counters ---
+
+void MemoryStorage::applyCounterDeltas(EntityKind kind, CounterDeltaMap& deltas, std::vector<EntityCity>& changed) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto& table = entities(kind);
+    for (const auto& [entityId, delta] : deltas) {
+        auto it = table.byId.find(entityId);
+        if (it == table.byId.end()) {
+            std::cerr << "Entity not found: " << entityId << std::endl;
+            continue;
+        }
+        auto& entity = it->second;
+        entity.swipesReceived += delta.swipesReceived;
+        entity.swipesMade += delta.swipesMade;
+        entity.matches += delta.matches;
+        entity.popularity = calculatePopularity(entity.swipesReceived, entity.swipesMade, entity.matches,
+                                                parseBudget(entity.budget));
+        changed.push_back({entity.country, entity.city});
+    }
+    deltas.clear();
+}
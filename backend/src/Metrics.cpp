@@ -0,0 +1,299 @@
+#include "Metrics.h"
+
+#include "AdminAuth.h"
+#include "BlockingExecutor.h"
+#include "DbMetrics.h"
+#include "EntityCardCache.h"
+#include "ResponseCache.h"
+#include "TraceCapture.h"
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Routes with their own series; paths seen after these are full are counted as "other"
+static constexpr size_t kMaxRoutes = 32;
+static constexpr size_t kUnmatchedRoute = 0;
+static constexpr size_t kOtherRoute = 1;
+
+// Status codes with their own series; any other code is counted as "other"
+static constexpr std::array<int, 10> kStatusCodes = {200, 304, 400, 404, 405, 409, 413, 500, 503, 504};
+static constexpr size_t kStatusSlots = kStatusCodes.size() + 1;
+
+// Log-linear latency buckets, HDR style: below 64us, then two per octave up to 2^26us (~67s),
+// split at 1.5x the octave's start, then unbounded. Relative error stays under 50%.
+static constexpr int kFirstOctave = 6;
+static constexpr int kLastOctave = 25;
+static constexpr size_t kLatencyBuckets = 1 + 2 * (kLastOctave - kFirstOctave + 1) + 1;
+
+namespace {
+
+struct LatencyHistogram {
+    std::array<std::atomic<uint64_t>, kLatencyBuckets> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumNanos{0};
+};
+
+// One io thread's share of the request metrics. Only its thread writes it; scrapes read it.
+struct ThreadMetrics {
+    std::atomic<int64_t> inFlight{0};
+    std::array<std::array<LatencyHistogram, kStatusSlots>, kMaxRoutes> latency;
+    std::array<std::array<LatencyHistogram, kStageCount>, kMaxRoutes> stages;
+};
+
+// A histogram summed over every thread's block
+struct HistogramTotals {
+    std::array<uint64_t, kLatencyBuckets> buckets{};
+    uint64_t count = 0;
+    uint64_t sumNanos = 0;
+
+    void add(const LatencyHistogram& histogram) {
+        count += histogram.count.load(std::memory_order_relaxed);
+        sumNanos += histogram.sumNanos.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kLatencyBuckets; ++i) {
+            buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+} // namespace
+
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadMetrics>> threadBlocks;
+static std::vector<std::string> routeNames = {"unmatched", "other"};
+static std::unordered_map<std::string, size_t> routeIndexes;
+
+// A single writer may increment without a locked instruction
+template <typename T>
+static void bump(std::atomic<T>& counter, T delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+static ThreadMetrics& threadMetrics() {
+    // Blocks outlive their thread so its counts stay in the totals
+    thread_local ThreadMetrics* block = [] {
+        auto owned = std::make_unique<ThreadMetrics>();
+        auto* raw = owned.get();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threadBlocks.push_back(std::move(owned));
+        return raw;
+    }();
+    return *block;
+}
+
+/// True for responses that may not come from a route: 404s, and admin auth rejections, which
+/// are answered for any path under the admin prefix.
+static bool isUnmatched(const crow::request& req, const crow::response& res) {
+    return res.code == 404 || isAdminAuthRejection(req, res);
+}
+
+/// The series index of a route, assigned the first time any thread sees it.
+static size_t routeIndex(const crow::request& req, const crow::response& res) {
+    if (isUnmatched(req, res)) return kUnmatchedRoute;
+    const std::string& path = req.url;
+
+    thread_local std::unordered_map<std::string, size_t> known;
+    auto it = known.find(path);
+    if (it != known.end()) return it->second;
+
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto global = routeIndexes.find(path);
+        if (global != routeIndexes.end()) {
+            index = global->second;
+        } else if (routeNames.size() < kMaxRoutes) {
+            index = routeNames.size();
+            routeNames.push_back(path);
+            routeIndexes.emplace(path, index);
+        } else {
+            return kOtherRoute;
+        }
+    }
+    known.emplace(path, index);
+    return index;
+}
+
+static size_t statusSlot(int code) {
+    for (size_t i = 0; i < kStatusCodes.size(); ++i) {
+        if (kStatusCodes[i] == code) return i;
+    }
+    return kStatusCodes.size();
+}
+
+static size_t latencyBucket(uint64_t micros) {
+    // Bounds are inclusive, as Prometheus' le is, so a value equal to one stays in its bucket
+    if (micros <= (1ULL << kFirstOctave)) return 0;
+    micros--;
+    int octave = 63 - __builtin_clzll(micros);
+    if (octave > kLastOctave) return kLatencyBuckets - 1;
+    // The bit below the leading one picks the octave's upper half
+    size_t upperHalf = (micros >> (octave - 1)) & 1;
+    return 1 + 2 * static_cast<size_t>(octave - kFirstOctave) + upperHalf;
+}
+
+/// Upper bound of a bounded latency bucket, in microseconds.
+static uint64_t latencyBucketBound(size_t bucket) {
+    if (bucket == 0) return 1ULL << kFirstOctave;
+    uint64_t octaveStart = 1ULL << (kFirstOctave + (bucket - 1) / 2);
+    return (bucket - 1) % 2 == 0 ? octaveStart + octaveStart / 2 : octaveStart * 2;
+}
+
+static void record(LatencyHistogram& histogram, std::chrono::nanoseconds elapsed) {
+    auto nanos = static_cast<uint64_t>(std::max<int64_t>(0, elapsed.count()));
+    bump(histogram.buckets[latencyBucket(nanos / 1000)], uint64_t{1});
+    bump(histogram.count, uint64_t{1});
+    bump(histogram.sumNanos, nanos);
+}
+
+void MetricsMiddleware::before_handle(crow::request& req, crow::response&, context& ctx) {
+    ctx.start = std::chrono::steady_clock::now();
+    ctx.trace = std::make_shared<RequestTrace>(makeRequestId(req.get_header_value("X-Request-Id")));
+    setCurrentRequestTrace(ctx.trace);
+    bump(threadMetrics().inFlight, int64_t{1});
+    if (traceCaptureArmed()) traceAsyncBegin("request", req.url, reinterpret_cast<uintptr_t>(ctx.trace.get()));
+}
+
+void MetricsMiddleware::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    auto elapsed = std::chrono::steady_clock::now() - ctx.start;
+    auto& block = threadMetrics();
+    size_t route = routeIndex(req, res);
+    record(block.latency[route][statusSlot(res.code)], elapsed);
+    bump(block.inFlight, int64_t{-1});
+
+    if (!ctx.trace) return;
+    if (traceCaptureArmed()) traceAsyncEnd("request", req.url, reinterpret_cast<uintptr_t>(ctx.trace.get()));
+    for (size_t stage = 0; stage < kStageCount; ++stage) {
+        auto nanos = ctx.trace->nanos[stage].load(std::memory_order_relaxed);
+        if (nanos > 0) record(block.stages[route][stage], std::chrono::nanoseconds(nanos));
+    }
+    logIfSlowRequest(*ctx.trace, crow::method_name(req.method).c_str(), isUnmatched(req, res) ? "unmatched" : req.url, res.code, elapsed);
+    res.set_header("X-Request-Id", ctx.trace->id);
+    if (currentRequestTrace() == ctx.trace) setCurrentRequestTrace(nullptr);
+}
+
+void appendMetricHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void appendMetricSample(std::string& out, std::string_view name, std::string_view labels, double value) {
+    out.append(name);
+    if (!labels.empty()) out.append("{").append(labels).append("}");
+    out.append(" ").append(formatMetricValue(value)).append("\n");
+}
+
+std::string formatMetricValue(double value) {
+    char number[32];
+    auto result = std::to_chars(number, number + sizeof(number), value);
+    return std::string(number, result.ptr);
+}
+
+std::string escapeLabelValue(std::string_view value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\') escaped += "\\\\";
+        else if (c == '"') escaped += "\\\"";
+        else if (c == '\n') escaped += "\\n";
+        else escaped += c;
+    }
+    return escaped;
+}
+
+/// Appends the _bucket, _sum and _count samples of one histogram series.
+static void appendHistogram(std::string& out, const std::string& name, const std::string& labels, const HistogramTotals& total) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < kLatencyBuckets; ++i) {
+        cumulative += total.buckets[i];
+        std::string bound = i + 1 < kLatencyBuckets ? formatMetricValue(latencyBucketBound(i) / 1e6) : "+Inf";
+        appendMetricSample(out, name + "_bucket", labels + ",le=\"" + bound + "\"", static_cast<double>(cumulative));
+    }
+    appendMetricSample(out, name + "_sum", labels, total.sumNanos / 1e9);
+    appendMetricSample(out, name + "_count", labels, static_cast<double>(total.count));
+}
+
+/// Appends the request latency and stage histograms summed over every thread, skipping empty series.
+static void appendRequestMetrics(std::string& out) {
+    std::vector<std::array<HistogramTotals, kStatusSlots>> latency(kMaxRoutes);
+    std::vector<std::array<HistogramTotals, kStageCount>> stages(kMaxRoutes);
+    std::vector<std::string> routes;
+    int64_t inFlight = 0;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        routes = routeNames;
+        for (const auto& block : threadBlocks) {
+            inFlight += block->inFlight.load(std::memory_order_relaxed);
+            for (size_t route = 0; route < routes.size(); ++route) {
+                for (size_t status = 0; status < kStatusSlots; ++status) latency[route][status].add(block->latency[route][status]);
+                for (size_t stage = 0; stage < kStageCount; ++stage) stages[route][stage].add(block->stages[route][stage]);
+            }
+        }
+    }
+
+    appendMetricHeader(out, "roommate_http_requests_in_flight", "gauge", "Requests being handled.");
+    appendMetricSample(out, "roommate_http_requests_in_flight", "", static_cast<double>(inFlight));
+
+    appendMetricHeader(out, "roommate_http_connections", "gauge", "Open HTTP connections.");
+    appendMetricSample(out, "roommate_http_connections", "", crow::connectionCount.load());
+
+    appendMetricHeader(out, "roommate_http_request_duration_seconds", "histogram",
+                       "Time from reading a request to completing its response, by route and status code.");
+    for (size_t route = 0; route < routes.size(); ++route) {
+        for (size_t status = 0; status < kStatusSlots; ++status) {
+            if (latency[route][status].count == 0) continue;
+            std::string labels = "route=\"" + escapeLabelValue(routes[route]) + "\",code=\"" +
+                                 (status < kStatusCodes.size() ? std::to_string(kStatusCodes[status]) : "other") + "\"";
+            appendHistogram(out, "roommate_http_request_duration_seconds", labels, latency[route][status]);
+        }
+    }
+
+    appendMetricHeader(out, "roommate_http_request_stage_seconds", "histogram",
+                       "Time requests spent in each handler stage, by route and stage.");
+    for (size_t route = 0; route < routes.size(); ++route) {
+        for (size_t stage = 0; stage < kStageCount; ++stage) {
+            if (stages[route][stage].count == 0) continue;
+            std::string labels = "route=\"" + escapeLabelValue(routes[route]) + "\",stage=\"" +
+                                 stageName(static_cast<Stage>(stage)) + "\"";
+            appendHistogram(out, "roommate_http_request_stage_seconds", labels, stages[route][stage]);
+        }
+    }
+}
+
+/// Appends the DB executor's occupancy and the effectiveness of the in-process caches.
+static void appendServerMetrics(std::string& out) {
+    auto& executor = getDbExecutor();
+    appendMetricHeader(out, "roommate_db_executor_queue_depth", "gauge", "Tasks waiting for a DB executor thread.");
+    appendMetricSample(out, "roommate_db_executor_queue_depth", "", static_cast<double>(executor.queueDepth()));
+    appendMetricHeader(out, "roommate_db_executor_queue_capacity", "gauge", "Tasks the DB executor queues before rejecting work.");
+    appendMetricSample(out, "roommate_db_executor_queue_capacity", "", static_cast<double>(executor.maxQueueDepth()));
+    appendMetricHeader(out, "roommate_db_executor_threads", "gauge", "DB executor threads.");
+    appendMetricSample(out, "roommate_db_executor_threads", "", static_cast<double>(executor.threadCount()));
+    appendMetricHeader(out, "roommate_db_executor_busy_threads", "gauge", "DB executor threads running a task.");
+    appendMetricSample(out, "roommate_db_executor_busy_threads", "", static_cast<double>(executor.threadCount() - executor.idleThreads()));
+    appendMetricHeader(out, "roommate_db_executor_rejected_total", "counter", "Tasks rejected because the DB executor queue was full.");
+    appendMetricSample(out, "roommate_db_executor_rejected_total", "", static_cast<double>(executor.rejected()));
+
+    auto& responses = getResponseCache();
+    appendMetricHeader(out, "roommate_response_cache_requests_total", "counter", "Response cache lookups by outcome.");
+    appendMetricSample(out, "roommate_response_cache_requests_total", "result=\"hit\"", static_cast<double>(responses.hits()));
+    appendMetricSample(out, "roommate_response_cache_requests_total", "result=\"miss\"", static_cast<double>(responses.misses()));
+    appendMetricSample(out, "roommate_response_cache_requests_total", "result=\"coalesced\"", static_cast<double>(responses.coalesced()));
+
+    auto& cards = getEntityCardCache();
+    appendMetricHeader(out, "roommate_card_cache_requests_total", "counter", "Entity card cache lookups by outcome.");
+    appendMetricSample(out, "roommate_card_cache_requests_total", "result=\"hit\"", static_cast<double>(cards.hits()));
+    appendMetricSample(out, "roommate_card_cache_requests_total", "result=\"miss\"", static_cast<double>(cards.misses()));
+}
+
+std::string renderPrometheusMetrics() {
+    std::string out;
+    out.reserve(64 * 1024);
+    appendRequestMetrics(out);
+    appendServerMetrics(out);
+    appendDbPrometheusMetrics(out);
+    return out;
+}
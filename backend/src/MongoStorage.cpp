@@ -0,0 +1,1107 @@
+#include "MongoStorage.h"
+#include "BlockingExecutor.h"
+#include "BsonFilter.h"
+#include "DbMetrics.h"
+#include "Deadline.h"
+#include "Popularity.h"
+#include "Records.h"
+#include "RequestTrace.h"
+
+#include <crow/crow_all.h>
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <mongocxx/exception/bulk_write_exception.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/options/bulk_write.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/options/find_one_and_update.hpp>
+#include <mongocxx/options/update.hpp>
+#include <mongocxx/read_preference.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::finalize;
+using bsoncxx::builder::stream::open_document;
+using bsoncxx::builder::stream::close_document;
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::oid;
+
+// Upper bound on the number of ids sent in a single `$in` lookup
+static constexpr size_t kLikerBatchSize = 500;
+
+// Maximum number of likers stored in a single liked-by inbox bucket
+static constexpr int kInboxBucketSize = 200;
+
+// Server error code of a write that would break a unique index
+static constexpr int kDuplicateKeyCode = 11000;
+
+// Cursor batch size for the full-corpus profile load
+static constexpr int32_t kProfileBatchSize = 5000;
+
+static int envInt(const char* name, int fallback) {
+    const char* value = getenv(name);
+    return value ? std::atoi(value) : fallback;
+}
+
+static mongocxx::collection& entityCollection(ClientLease& client, EntityKind kind) {
+    return kind == EntityKind::User ? client.getUserCollection() : client.getRoomCollection();
+}
+
+static mongocxx::collection& swipeCollection(ClientLease& client, EntityKind kind) {
+    return kind == EntityKind::User ? client.getUserSwipeCollection() : client.getRoomSwipeCollection();
+}
+
+static mongocxx::collection& likesInboxCollection(ClientLease& client, EntityKind kind) {
+    return kind == EntityKind::User ? client.getUserLikesInboxCollection() : client.getRoomLikesInboxCollection();
+}
+
+static const char* entityCollectionName(EntityKind kind) {
+    return kind == EntityKind::User ? "users" : "rooms";
+}
+
+static const char* swipeCollectionName(EntityKind kind) {
+    return kind == EntityKind::User ? "user_swipes" : "room_swipes";
+}
+
+static const char* likesInboxCollectionName(EntityKind kind) {
+    return kind == EntityKind::User ? "user_likes_inbox" : "room_likes_inbox";
+}
+
+// --- Deadlines and hedged reads ---
+
+/**
+ * Caps a read or findAndModify at the request's remaining deadline via maxTimeMS.
+ * @throws DeadlineExceeded if the deadline has already passed.
+ */
+template <typename Options>
+static Options& withDeadline(Options& options) {
+    if (auto remaining = remainingBudget()) options.max_time(*remaining);
+    return options;
+}
+
+static const mongocxx::read_preference& hedgeReadPreference() {
+    static const mongocxx::read_preference preference = [] {
+        mongocxx::read_preference preference;
+        preference.mode(mongocxx::read_preference::read_mode::k_secondary_preferred);
+        return preference;
+    }();
+    return preference;
+}
+
+/**
+ * Options for one attempt of an idempotent read: the request's deadline and, for the hedge
+ * attempt, a read preference that sends it to a secondary when the deployment has one.
+ */
+static mongocxx::options::find& withReadAttempt(mongocxx::options::find& options, bool hedge) {
+    withDeadline(options);
+    if (hedge) options.read_preference(hedgeReadPreference());
+    return options;
+}
+
+/**
+ * How long a read waits before it is hedged: DB_HEDGE_DELAY_MS when set, otherwise the
+ * command's observed p95 latency.
+ * @return The delay, or std::nullopt when hedging is off (DB_HEDGED_READS unset) or the
+ *         command has too few samples yet.
+ */
+static std::optional<std::chrono::microseconds> hedgeDelay(const std::string& command, const std::string& collection) {
+    static const bool enabled = envInt("DB_HEDGED_READS", 0) != 0;
+    static const int fixedDelayMs = envInt("DB_HEDGE_DELAY_MS", 0);
+    if (!enabled) return std::nullopt;
+    if (fixedDelayMs > 0) return std::chrono::milliseconds(fixedDelayMs);
+
+    int64_t p95 = commandLatencyPercentileMicros(command, collection, 0.95);
+    if (p95 <= 0) return std::nullopt;
+    return std::chrono::microseconds(p95);
+}
+
+/**
+ * The pool hedged reads run their attempts on: DB_HEDGE_THREADS workers (default 8). It is kept
+ * apart from the DB executor, whose workers wait on the attempts, so an attempt never waits
+ * for a thread held by a request that is waiting for it.
+ */
+static BlockingExecutor& hedgeExecutor() {
+    static const size_t threads = static_cast<size_t>(std::max(1, envInt("DB_HEDGE_THREADS", 8)));
+    static BlockingExecutor executor(threads, threads);
+    return executor;
+}
+
+/**
+ * Runs an idempotent read and, if it has not answered after the hedge delay, races a second
+ * attempt sent to a secondary; the first successful answer wins. Both attempts run on the hedge
+ * pool with their own pooled client, under the caller's deadline, trace and DB accounting.
+ * Falls back to a plain read on the calling thread when hedging is off or the hedge pool is
+ * saturated. The caller waits at most until its deadline or DB_HEDGE_MAX_WAIT_MS (default
+ * 10000), whichever comes first; stalled attempts are left to finish on the pool, never re-sent.
+ * @param command The command whose latency sets the hedge delay, e.g. "find".
+ * @param collection The collection the read starts on.
+ * @param read Callable taking `bool hedge`. A losing attempt may outlive the call, so it must
+ *             own everything it captures.
+ * @throws DeadlineExceeded if neither attempt answers before the deadline or the maximum wait.
+ */
+template <typename Read>
+static auto hedgedRead(const std::string& command, const std::string& collection, Read read) -> decltype(read(false)) {
+    using Result = decltype(read(false));
+
+    auto delay = hedgeDelay(command, collection);
+    if (!delay) return read(false);
+
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable settled;
+        std::optional<Result> result;
+        std::exception_ptr error;
+        int pending = 0;
+        // MongoDB commands of the attempts that have finished
+        int roundTrips = 0;
+        int64_t micros = 0;
+    };
+    auto race = std::make_shared<Race>();
+    auto deadline = currentDeadline();
+    auto trace = currentRequestTrace();
+
+    auto submit = [&](bool hedge) {
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->pending++;
+        }
+        bool queued = hedgeExecutor().trySubmit([race, read, deadline, trace, hedge]() mutable {
+            std::optional<Result> result;
+            std::exception_ptr error;
+            int roundTrips = 0;
+            int64_t micros = 0;
+            {
+                DeadlineScope deadlineScope(deadline);
+                DbWorkScope dbScope;
+                RequestTraceScope traceScope(trace);
+                try {
+                    result = read(hedge);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                roundTrips = dbScope.roundTrips();
+                micros = dbScope.micros();
+            }
+
+            std::lock_guard<std::mutex> lock(race->mutex);
+            if (result && !race->result) race->result = std::move(result);
+            if (error) race->error = error;
+            race->roundTrips += roundTrips;
+            race->micros += micros;
+            race->pending--;
+            race->settled.notify_all();
+        });
+        if (!queued) {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->pending--;
+        }
+        return queued;
+    };
+
+    if (!submit(false)) return read(false);
+
+    auto done = [&race] { return race->result || race->pending == 0; };
+    std::unique_lock<std::mutex> lock(race->mutex);
+    if (!race->settled.wait_for(lock, *delay, done)) {
+        lock.unlock();
+        if (submit(true)) countHedgedRead();
+        lock.lock();
+    }
+
+    static const auto maxWait = std::chrono::milliseconds(std::max(1, envInt("DB_HEDGE_MAX_WAIT_MS", 10000)));
+    bool settled = race->settled.wait_until(lock, std::min(deadline, DeadlineClock::now() + maxWait), done);
+    addToDbRequest(race->roundTrips, race->micros);
+    if (!settled) throw DeadlineExceeded();
+    if (race->result) return std::move(*race->result);
+    std::rethrow_exception(race->error);
+}
+
+MongoStorage::MongoStorage(DBManager& manager) : manager_(manager) {}
+
+std::optional<EntityRecord> MongoStorage::findEntity(EntityKind kind, const std::string& id) {
+    auto client = manager_.acquire();
+    auto& collection = entityCollection(client, kind);
+    BsonFilter filter;
+    filter.append("_id", oid(id));
+    mongocxx::options::find opts;
+    auto doc = collection.find_one(filter.view(), withDeadline(opts));
+    if (!doc) return std::nullopt;
+    return decodeBson<EntityRecord>(doc->view());
+}
+
+std::vector<EntityRecord> MongoStorage::findEntities(EntityKind kind, const std::vector<std::string>& ids) {
+    if (ids.empty()) return {};
+
+    bsoncxx::builder::basic::array oids;
+    for (const auto& id : ids) {
+        oids.append(oid(id));
+    }
+    auto filter = bsoncxx::builder::basic::make_document(
+        kvp("_id", bsoncxx::builder::basic::make_document(kvp("$in", oids.extract()))));
+
+    return hedgedRead("find", entityCollectionName(kind), [this, kind, filter](bool hedge) {
+        auto client = manager_.acquire();
+        auto& collection = entityCollection(client, kind);
+
+        mongocxx::options::find opts;
+        std::vector<EntityRecord> entities;
+        for (auto&& doc : collection.find(filter.view(), withReadAttempt(opts, hedge))) {
+            entities.push_back(decodeBson<EntityRecord>(doc));
+        }
+        return entities;
+    });
+}
+
+/**
+ * Scans a city with only the ranking fields projected; the cards of the entities that make
+ * the cut are read separately, and mostly come from the card cache.
+ */
+std::vector<EntityRank> MongoStorage::rankEntitiesInCity(EntityKind kind, const std::string& country, const std::string& city) {
+    return hedgedRead("find", entityCollectionName(kind), [this, kind, country, city](bool hedge) {
+        auto client = manager_.acquire();
+        auto& collection = entityCollection(client, kind);
+        BsonFilter filter;
+        filter.append("country", country).append("city", city);
+
+        static const auto projection = document{} << "_id" << 1 << "ownerId" << 1 << "popularity" << 1 << finalize;
+        mongocxx::options::find opts;
+        opts.projection(projection.view());
+        std::vector<EntityRank> entities;
+        for (auto&& doc : collection.find(filter.view(), withReadAttempt(opts, hedge))) {
+            entities.push_back(decodeBson<EntityRank>(doc));
+        }
+        return entities;
+    });
+}
+
+// --- Profiles ---
+
+/**
+ * Builds the boundary ObjectId for a timestamp; every id generated at or after `seconds` sorts at or above it.
+ * @param seconds The ObjectId timestamp.
+ */
+static oid oidAtTimestamp(uint32_t seconds) {
+    char bytes[12] = {};
+    bytes[0] = static_cast<char>(seconds >> 24);
+    bytes[1] = static_cast<char>(seconds >> 16);
+    bytes[2] = static_cast<char>(seconds >> 8);
+    bytes[3] = static_cast<char>(seconds);
+    return oid(bytes, sizeof(bytes));
+}
+
+static uint32_t oidTimestamp(const oid& id) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(id.bytes());
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+/**
+ * Splits the user _id space into `parts` contiguous ranges by ObjectId timestamp.
+ * The first range has no lower bound and the last no upper bound, so ids outside
+ * the sampled min/max are still covered.
+ * @param user_collection The users collection.
+ * @param parts The number of ranges wanted.
+ * @return Range boundaries; range i is [bounds[i-1], bounds[i]).
+ */
+static std::vector<oid> splitUserIdRanges(mongocxx::collection& user_collection, size_t parts) {
+    mongocxx::options::find opts;
+    withDeadline(opts);
+    opts.projection(document{} << "_id" << 1 << finalize);
+
+    opts.sort(document{} << "_id" << 1 << finalize);
+    auto first = user_collection.find_one({}, opts);
+    opts.sort(document{} << "_id" << -1 << finalize);
+    auto last = user_collection.find_one({}, opts);
+
+    std::vector<oid> bounds;
+    if (!first || !last || parts < 2) return bounds;
+    auto first_id = decodeBson<ProfileFields>(first->view()).id;
+    auto last_id = decodeBson<ProfileFields>(last->view()).id;
+    if (!first_id || !last_id) return bounds;
+
+    uint32_t lo = oidTimestamp(*first_id);
+    uint32_t hi = oidTimestamp(*last_id);
+    uint32_t step = (hi - lo) / parts;
+    if (step == 0) return bounds;
+    for (size_t i = 1; i < parts; ++i) {
+        bounds.push_back(oidAtTimestamp(lo + step * i));
+    }
+    return bounds;
+}
+
+/**
+ * Scans one _id range of the users collection and tokenizes each profile.
+ * @param manager The pool to lease the scan's client from.
+ * @param lower Inclusive lower bound, or none for the first range.
+ * @param upper Exclusive upper bound, or none for the last range.
+ * @param out Profiles are appended here.
+ */
+static void loadProfileRange(DBManager& manager, const std::optional<oid>& lower, const std::optional<oid>& upper, std::vector<Profile>& out) {
+    auto client = manager.acquire();
+    auto& user_collection = client.getUserCollection();
+
+    bsoncxx::builder::basic::document filter;
+    if (lower || upper) {
+        bsoncxx::builder::basic::document range;
+        if (lower) range.append(kvp("$gte", *lower));
+        if (upper) range.append(kvp("$lt", *upper));
+        filter.append(kvp("_id", range.extract()));
+    }
+
+    static const auto projection = document{} << "_id" << 1 << "city" << 1 << "state" << 1 << "country" << 1
+                                              << "zipcode" << 1 << "budget" << 1 << finalize;
+    mongocxx::options::find opts;
+    opts.projection(projection.view());
+    opts.batch_size(kProfileBatchSize);
+    withDeadline(opts);
+
+    for (auto&& doc : user_collection.find(filter.view(), opts)) {
+        auto fields = decodeBson<ProfileFields>(doc);
+        if (!fields.id) continue;
+
+        Profile profile;
+        profile.id =        fields.id->to_string();
+        profile.city =      std::string(fields.city);
+        profile.state =     std::string(fields.state);
+        profile.country =   std::string(fields.country);
+        profile.zipcode =   std::string(fields.zipcode);
+        profile.budget =    std::string(fields.budget);
+        tokenizeProfile(profile);
+        out.push_back(std::move(profile));
+    }
+}
+
+// Helper threads scanning profile ranges, summed over every loadProfiles() call in flight
+static std::atomic<size_t> profileScanHelpers{0};
+
+/// Claims a helper thread slot unless `limit` helpers are already scanning.
+static bool tryAcquireScanHelper(size_t limit) {
+    size_t helpers = profileScanHelpers.load();
+    while (helpers < limit) {
+        if (profileScanHelpers.compare_exchange_weak(helpers, helpers + 1)) return true;
+    }
+    return false;
+}
+
+/**
+ * Loads every user's profile. The _id space is split into PROFILE_LOAD_THREADS ranges (default:
+ * the hardware threads) that the calling thread and helper threads scan and tokenize, one pooled
+ * client at a time each. The helpers of all concurrent loads share PROFILE_LOAD_THREADS - 1
+ * slots, so concurrent loads split the scan parallelism instead of multiplying it; a load that
+ * gets no helper scans its ranges on the calling thread.
+ * @return The profiles, in _id range order.
+ */
+std::vector<Profile> MongoStorage::loadProfiles() {
+    static const size_t threads = static_cast<size_t>(std::max(1, envInt("PROFILE_LOAD_THREADS",
+                                                                          static_cast<int>(std::thread::hardware_concurrency()))));
+    int64_t estimated = 0;
+    std::vector<oid> bounds;
+    {
+        auto client = manager_.acquire();
+        auto& user_collection = client.getUserCollection();
+        estimated = user_collection.estimated_document_count();
+        // Small collections are not worth the extra round trips and clients
+        if (estimated >= static_cast<int64_t>(kProfileBatchSize)) {
+            bounds = splitUserIdRanges(user_collection, threads);
+        }
+    }
+
+    size_t ranges = bounds.size() + 1;
+    std::vector<std::vector<Profile>> parts(ranges);
+    std::vector<std::exception_ptr> errors(ranges);
+    std::atomic<size_t> nextRange{0};
+    auto scanRanges = [&, deadline = currentDeadline()] {
+        // Helpers run on their own threads, which do not inherit the request's deadline
+        DeadlineScope scope(deadline);
+        for (size_t i; (i = nextRange++) < ranges;) {
+            std::optional<oid> lower = i > 0 ? std::optional<oid>(bounds[i - 1]) : std::nullopt;
+            std::optional<oid> upper = i < bounds.size() ? std::optional<oid>(bounds[i]) : std::nullopt;
+            parts[i].reserve(static_cast<size_t>(estimated) / ranges);
+            try {
+                loadProfileRange(manager_, lower, upper, parts[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < ranges && tryAcquireScanHelper(threads - 1); ++i) {
+        helpers.emplace_back([&scanRanges] {
+            scanRanges();
+            profileScanHelpers--;
+        });
+    }
+    scanRanges();
+    for (auto& helper : helpers) helper.join();
+    for (auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    std::vector<Profile> profiles;
+    size_t total = 0;
+    for (const auto& part : parts) total += part.size();
+    profiles.reserve(total);
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(profiles));
+    }
+    return profiles;
+}
+
+// --- Swipes ---
+
+bool MongoStorage::recordSwipe(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) {
+    auto client = manager_.acquire();
+    auto& swipe_collection = swipeCollection(client, targetKind);
+    BsonFilter filter;
+    filter.append("sourceEntityId", sourceId);
+
+    // The driver's update options have no maxTimeMS, so only refuse to start past the deadline
+    remainingBudget();
+    mongocxx::options::update opts;
+    opts.upsert(true);
+    auto swipe_result = swipe_collection.update_one(
+        filter.view(),
+        document{}
+            << "$setOnInsert" << open_document
+                << "sourceEntityId" << sourceId
+            << close_document
+            << "$addToSet" << open_document
+                << "targetEntityId" << targetId
+            << close_document
+            << finalize,
+        opts);
+
+    // $addToSet leaves the document untouched when the target was already swiped
+    return swipe_result && (swipe_result->modified_count() > 0 || swipe_result->upserted_id());
+}
+
+/**
+ * Adds every target to the source's swipe document in one findAndModify. The pre-image is
+ * projected down to the batch's targets that were already there, so the reply stays small
+ * however many swipes the source has made (aggregation projections need MongoDB 4.4).
+ */
+std::vector<bool> MongoStorage::recordSwipes(EntityKind targetKind, const std::string& sourceId, const std::vector<std::string>& targetIds) {
+    if (targetIds.empty()) return {};
+    auto client = manager_.acquire();
+    auto& swipe_collection = swipeCollection(client, targetKind);
+
+    bsoncxx::builder::basic::array targets;
+    for (const auto& targetId : targetIds) {
+        targets.append(targetId);
+    }
+    auto targetArray = targets.extract();
+
+    using bsoncxx::builder::basic::make_array;
+    using bsoncxx::builder::basic::make_document;
+    auto projection = make_document(
+        kvp("_id", 0),
+        kvp("targetEntityId", make_document(kvp("$filter", make_document(
+            kvp("input", make_document(kvp("$ifNull", make_array("$targetEntityId", make_array())))),
+            kvp("cond", make_document(kvp("$in", make_array("$$this", targetArray.view())))))))));
+
+    mongocxx::options::find_one_and_update opts;
+    opts.upsert(true);
+    opts.return_document(mongocxx::options::return_document::k_before);
+    opts.projection(projection.view());
+    withDeadline(opts);
+    BsonFilter filter;
+    filter.append("sourceEntityId", sourceId);
+    auto before = swipe_collection.find_one_and_update(
+        filter.view(),
+        make_document(
+            kvp("$setOnInsert", make_document(kvp("sourceEntityId", sourceId))),
+            kvp("$addToSet", make_document(kvp("targetEntityId", make_document(kvp("$each", targetArray.view())))))),
+        opts);
+
+    std::vector<bool> isNew(targetIds.size(), true);
+    if (!before) return isNew;  // Upserted: the source had no swipes yet
+    auto existing = before->view()["targetEntityId"];
+    if (!existing || existing.type() != bsoncxx::type::k_array) return isNew;
+    for (auto&& element : existing.get_array().value) {
+        if (element.type() != bsoncxx::type::k_string) continue;
+        auto id = element.get_string().value;
+        for (size_t i = 0; i < targetIds.size(); ++i) {
+            if (targetIds[i] == std::string_view(id.data(), id.size())) isNew[i] = false;
+        }
+    }
+    return isNew;
+}
+
+bool MongoStorage::hasSwiped(EntityKind targetKind, const std::string& sourceId, const std::string& targetId) {
+    auto client = manager_.acquire();
+    auto& swipe_collection = swipeCollection(client, targetKind);
+    BsonFilter filter;
+    filter.append("sourceEntityId", sourceId).append("targetEntityId", targetId);
+    mongocxx::options::find opts;
+    return static_cast<bool>(swipe_collection.find_one(filter.view(), withDeadline(opts)));
+}
+
+std::vector<std::string> MongoStorage::findSwipersOf(EntityKind targetKind, const std::vector<std::string>& sourceIds, const std::string& targetId) {
+    if (sourceIds.empty()) return {};
+    auto client = manager_.acquire();
+    auto& swipe_collection = swipeCollection(client, targetKind);
+
+    bsoncxx::builder::basic::array sources;
+    for (const auto& sourceId : sourceIds) {
+        sources.append(sourceId);
+    }
+    auto filter = bsoncxx::builder::basic::make_document(
+        kvp("sourceEntityId", bsoncxx::builder::basic::make_document(kvp("$in", sources.extract()))),
+        kvp("targetEntityId", targetId));
+
+    static const auto projection = document{} << "_id" << 0 << "sourceEntityId" << 1 << finalize;
+    mongocxx::options::find opts;
+    opts.projection(projection.view());
+    std::vector<std::string> swipers;
+    for (auto&& doc : swipe_collection.find(filter.view(), withDeadline(opts))) {
+        auto source = doc["sourceEntityId"];
+        if (source && source.type() == bsoncxx::type::k_string) {
+            swipers.emplace_back(source.get_string().value);
+        }
+    }
+    return swipers;
+}
+
+/**
+ * Reads the fields of a liker's card in the likes inbox.
+ * @return The liker's document, or std::nullopt (logged) if the user does not exist.
+ */
+static std::optional<bsoncxx::document::value> findLikerCard(ClientLease& client, const std::string& likerId) {
+    static const auto card_projection = document{} << "username" << 1 << "popularity" << 1 << "matches" << 1 << finalize;
+    mongocxx::options::find card_opts;
+    card_opts.projection(card_projection.view());
+    withDeadline(card_opts);
+    BsonFilter liker_filter;
+    liker_filter.append("_id", oid(likerId));
+    auto liker_doc = client.getUserCollection().find_one(liker_filter.view(), card_opts);
+    if (!liker_doc) {
+        std::cerr << "Liker not found: " << likerId << std::endl;
+    }
+    return liker_doc;
+}
+
+/**
+ * Matches the target's open inbox bucket unless it already lists the liker; otherwise an
+ * upsert starts a new bucket. A liker listed in any other bucket makes the write fail the
+ * unique (entityId, likers.id) index, so concurrent pushes of one like list it once.
+ */
+static bsoncxx::document::value openInboxBucket(const std::string& targetId, const std::string& likerId) {
+    return document{}
+        << "entityId" << targetId
+        << "count" << open_document << "$lt" << kInboxBucketSize << close_document
+        << "likers.id" << open_document << "$ne" << likerId << close_document
+        << finalize;
+}
+
+/// Pushes the liker's card onto an inbox bucket of the target.
+static bsoncxx::document::value pushLikerCard(const std::string& targetId, const std::string& likerId, const LikerCard& liker) {
+    return document{}
+        << "$setOnInsert" << open_document
+            << "entityId" << targetId
+        << close_document
+        << "$push" << open_document
+            << "likers" << open_document
+                << "id" << likerId
+                << "username" << std::string(liker.username)
+                << "popularity" << liker.popularity
+                << "matches" << liker.matches
+                << "likedAt" << bsoncxx::types::b_date{std::chrono::system_clock::now()}
+            << close_document
+        << close_document
+        << "$inc" << open_document
+            << "count" << 1
+        << close_document
+        << finalize;
+}
+
+/**
+ * The indexes of the writes a failed bulk write rejected as duplicate keys. Call it from the
+ * handler of `e`: if any write failed for another reason, or the failure was not a write
+ * error, it rethrows `e`.
+ */
+static std::vector<size_t> duplicateKeyWrites(const mongocxx::bulk_write_exception& e) {
+    const auto& reply = e.raw_server_error();
+    if (!reply) throw;
+    auto errors = reply->view()["writeErrors"];
+    if (!errors || errors.type() != bsoncxx::type::k_array) throw;
+
+    std::vector<size_t> indexes;
+    for (auto&& error : errors.get_array().value) {
+        auto code = error["code"];
+        auto index = error["index"];
+        if (!code || code.type() != bsoncxx::type::k_int32 || code.get_int32().value != kDuplicateKeyCode) throw;
+        if (!index || index.type() != bsoncxx::type::k_int32) throw;
+        indexes.push_back(static_cast<size_t>(index.get_int32().value));
+    }
+    return indexes;
+}
+
+/**
+ * Appends a liker to the target's liked-by inbox unless it is listed there already, so a
+ * like whose first attempt failed after its swipe was written can simply be recorded again.
+ * The write itself is the check (see openInboxBucket()): a duplicate key error means another
+ * attempt listed the liker first.
+ * The inbox is split into time-ordered buckets of at most kInboxBucketSize likers, each
+ * holding a denormalized card of the liker so reads never have to touch the user collection.
+ */
+bool MongoStorage::recordLike(EntityKind targetKind, const std::string& likerId, const std::string& targetId) {
+    auto client = manager_.acquire();
+    auto& inbox_collection = likesInboxCollection(client, targetKind);
+
+    auto liker_doc = findLikerCard(client, likerId);
+    if (!liker_doc) return false;
+    auto liker = decodeBson<LikerCard>(liker_doc->view());
+
+    remainingBudget();
+    mongocxx::options::update opts;
+    opts.upsert(true);
+    try {
+        inbox_collection.update_one(
+            openInboxBucket(targetId, likerId).view(), pushLikerCard(targetId, likerId, liker).view(), opts);
+    } catch (const mongocxx::bulk_write_exception& e) {
+        duplicateKeyWrites(e);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the liker's card once and pushes it to the inbox of every target in one unordered
+ * bulk write. Targets already listing the liker fail their push with a duplicate key error
+ * and report false; any other write error is rethrown.
+ */
+std::vector<bool> MongoStorage::recordLikes(EntityKind targetKind, const std::string& likerId, const std::vector<std::string>& targetIds) {
+    std::vector<bool> listed(targetIds.size(), false);
+    if (targetIds.empty()) return listed;
+    auto client = manager_.acquire();
+    auto& inbox_collection = likesInboxCollection(client, targetKind);
+
+    auto liker_doc = findLikerCard(client, likerId);
+    if (!liker_doc) return listed;
+    auto liker = decodeBson<LikerCard>(liker_doc->view());
+
+    remainingBudget();
+    mongocxx::options::bulk_write bulk_opts;
+    bulk_opts.ordered(false);
+    auto bulk = inbox_collection.create_bulk_write(bulk_opts);
+    for (size_t i = 0; i < targetIds.size(); ++i) {
+        mongocxx::model::update_one push(openInboxBucket(targetIds[i], likerId).view(), pushLikerCard(targetIds[i], likerId, liker).view());
+        push.upsert(true);
+        bulk.append(push);
+    }
+    listed.assign(targetIds.size(), true);
+    try {
+        bulk.execute();
+    } catch (const mongocxx::bulk_write_exception& e) {
+        // The pushes were appended in target order
+        for (size_t i : duplicateKeyWrites(e)) listed[i] = false;
+    }
+    return listed;
+}
+
+// --- Likes ---
+
+/**
+ * Position of a likes page. Serialized into the opaque cursor so clients never depend on
+ * whether a page came from the liked-by inbox or the swipe scan.
+ */
+struct LikesCursor {
+    bool fromInbox = true;
+    std::string lastId;  // Inbox bucket to resume in, or the last swipe document returned
+    int nextIndex = -1;  // Inbox only: the next liker index to emit, walking backwards
+};
+
+// Swipe scan position before the first swipe document; every ObjectId sorts after it
+static const std::string kSwipeScanStart(24, '0');
+
+/**
+ * The first swipe document `_id` created once the liked-by inbox was live, from
+ * LIKES_INBOX_SINCE (Unix seconds). A source whose swipe document is that new has every like
+ * in the inbox, so the swipe scan stops before it; unset, no swipe document predates the inbox.
+ */
+static const std::optional<oid>& likesInboxSince() {
+    static const std::optional<oid> since = []() -> std::optional<oid> {
+        const char* value = getenv("LIKES_INBOX_SINCE");
+        long long seconds = value ? std::atoll(value) : 0;
+        if (seconds <= 0) return std::nullopt;
+        return oidAtTimestamp(static_cast<uint32_t>(seconds));
+    }();
+    return since;
+}
+
+static std::string encodeLikesCursor(const LikesCursor& cursor) {
+    std::string raw = cursor.fromInbox
+        ? "i:" + cursor.lastId + ":" + std::to_string(cursor.nextIndex)
+        : "s:" + cursor.lastId;
+    return crow::utility::base64encode_urlsafe(raw, raw.size());
+}
+
+static std::optional<LikesCursor> decodeLikesCursor(const std::string& encoded) {
+    std::string raw = crow::utility::base64decode(encoded, encoded.size());
+    if (raw.size() < 2 + 24 || raw[1] != ':') return std::nullopt;
+
+    LikesCursor cursor;
+    cursor.fromInbox = raw[0] == 'i';
+    cursor.lastId = raw.substr(2, 24);
+    if (cursor.lastId.find_first_not_of("0123456789abcdef") != std::string::npos) return std::nullopt;
+
+    if (raw[0] == 's' && raw.size() == 2 + 24) return cursor;
+    if (raw[0] == 'i' && raw.size() > 2 + 24 + 1 && raw[2 + 24] == ':') {
+        try {
+            cursor.nextIndex = std::stoi(raw.substr(2 + 24 + 1));
+            return cursor;
+        } catch (...) {
+            return std::nullopt;
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * The members of `likerIds` that the entity's liked-by inbox already lists.
+ */
+static std::unordered_set<std::string> findInboxLikers(mongocxx::collection& inbox_collection,
+                                                       const std::string& entityId,
+                                                       const std::vector<std::pair<std::string, std::string>>& likerIds,
+                                                       bool hedge) {
+    bsoncxx::builder::basic::array ids;
+    for (const auto& liker : likerIds) {
+        ids.append(liker.first);
+    }
+    auto filter = bsoncxx::builder::basic::make_document(
+        kvp("entityId", entityId),
+        kvp("likers.id", bsoncxx::builder::basic::make_document(kvp("$in", ids.extract()))));
+
+    static const auto projection = document{} << "_id" << 0 << "likers.id" << 1 << finalize;
+    mongocxx::options::find opts;
+    opts.projection(projection.view());
+    withReadAttempt(opts, hedge);
+
+    std::unordered_set<std::string> wanted;
+    for (const auto& liker : likerIds) wanted.insert(liker.first);
+    std::unordered_set<std::string> listed;
+    for (auto&& bucket : inbox_collection.find(filter.view(), opts)) {
+        for (auto&& card : bucket["likers"].get_array().value) {
+            std::string id(card.get_document().value["id"].get_string().value);
+            if (wanted.count(id)) listed.insert(std::move(id));
+        }
+    }
+    return listed;
+}
+
+/**
+ * Fetches one page of users who liked an entity by scanning the swipe collection, skipping
+ * likers the entity's liked-by inbox already lists. This is the tail of a likes listing: it
+ * returns the likes recorded before the inbox existed, after the inbox has run out. Only
+ * swipe documents older than likesInboxSince() are scanned, so its cost is bounded by the
+ * entity's pre-inbox swipers. Those documents do not tell likes from dislikes, so, as before
+ * the inbox, every swipe they hold is listed.
+ * Pages are ordered by swipe `_id` so each scan is an indexed range query on (targetEntityId, _id).
+ * @param swipe_collection The swipe collection for the entity's type.
+ * @param user_collection The user collection.
+ * @param inbox_collection The liked-by inbox collection for the entity's type.
+ * @param entityId The ID of the entity to check likes for.
+ * @param afterSwipeId The last swipe document of the previous page, or kSwipeScanStart.
+ * @param before likesInboxSince().
+ * @param limit The maximum number of likers to return; 0 only checks whether there are any.
+ * @param hedge Whether this is the hedge attempt of a hedged read.
+ * @return The page of likers.
+ */
+static LikersPage fetchLikersFromSwipes(mongocxx::collection& swipe_collection,
+                                        mongocxx::collection& user_collection,
+                                        mongocxx::collection& inbox_collection,
+                                        const std::string& entityId,
+                                        const std::string& afterSwipeId,
+                                        const oid& before,
+                                        size_t limit,
+                                        bool hedge) {
+    LikersPage page;
+
+    auto filter = document{}
+        << "targetEntityId" << entityId
+        << "_id" << open_document << "$gt" << oid(afterSwipeId) << "$lt" << before << close_document
+        << finalize;
+
+    // Only the liker id is needed from each swipe document
+    mongocxx::options::find swipe_opts;
+    static const auto swipe_projection = document{} << "sourceEntityId" << 1 << finalize;
+    static const auto swipe_sort = document{} << "_id" << 1 << finalize;
+    swipe_opts.projection(swipe_projection.view());
+    swipe_opts.sort(swipe_sort.view());
+    swipe_opts.batch_size(static_cast<std::int32_t>(kLikerBatchSize));
+    withReadAttempt(swipe_opts, hedge);
+
+    // (liker id, swipe id) pairs, checked against the inbox a batch at a time. One liker past
+    // the limit tells us there is a next page.
+    std::vector<std::pair<std::string, std::string>> likers, batch;
+    auto keepUnlisted = [&] {
+        auto listed = findInboxLikers(inbox_collection, entityId, batch, hedge);
+        for (auto& liker : batch) {
+            if (!listed.count(liker.first)) likers.push_back(std::move(liker));
+        }
+        batch.clear();
+    };
+    for (auto&& swipe_doc : swipe_collection.find(filter.view(), swipe_opts)) {
+        batch.emplace_back(std::string(swipe_doc["sourceEntityId"].get_string().value),
+                           swipe_doc["_id"].get_oid().value.to_string());
+        if (batch.size() == kLikerBatchSize) {
+            keepUnlisted();
+            if (likers.size() > limit) break;
+        }
+    }
+    if (!batch.empty()) keepUnlisted();
+
+    if (likers.size() > limit) {
+        likers.resize(limit);
+        page.nextCursor = encodeLikesCursor({false, likers.empty() ? afterSwipeId : likers.back().second, -1});
+    }
+
+    static const auto user_projection = document{} << "username" << 1 << "popularity" << 1 << "matches" << 1 << finalize;
+    mongocxx::options::find user_opts;
+    user_opts.projection(user_projection.view());
+    withReadAttempt(user_opts, hedge);
+
+    // Resolve likers with bounded `$in` batches instead of one find_one() per liker
+    page.likers.reserve(likers.size());
+    for (size_t begin = 0; begin < likers.size(); begin += kLikerBatchSize) {
+        size_t end = std::min(likers.size(), begin + kLikerBatchSize);
+
+        bsoncxx::builder::basic::array ids;
+        for (size_t i = begin; i < end; ++i) {
+            ids.append(oid(likers[i].first));
+        }
+
+        std::unordered_map<std::string, LikerRecord> found;
+        auto user_cursor = user_collection.find(
+            document{} << "_id" << open_document << "$in" << bsoncxx::types::b_array{ids.view()} << close_document << finalize,
+            user_opts
+        );
+        for (auto&& user_view : user_cursor) {
+            auto liker = decodeBson<LikerCard>(user_view);
+            if (!liker.id) continue;
+            LikerRecord record;
+            record.id = liker.id->to_string();
+            record.username = std::string(liker.username);
+            record.popularity = liker.popularity;
+            record.matches = liker.matches;
+            found.emplace(record.id, std::move(record));
+        }
+
+        // `$in` gives no ordering guarantee, so emit in swipe order
+        for (size_t i = begin; i < end; ++i) {
+            auto it = found.find(likers[i].first);
+            if (it != found.end()) {
+                page.likers.push_back(std::move(it->second));
+            }
+        }
+    }
+    return page;
+}
+
+/**
+ * Fetches one page of users who liked an entity from its liked-by inbox, newest first.
+ * Buckets are read lazily in descending `_id` order, so a page touches at most
+ * limit / kInboxBucketSize + 1 buckets.
+ * @param inbox_collection The liked-by inbox collection for the entity's type.
+ * @param entityId The ID of the entity to check likes for.
+ * @param position Where the previous page stopped, or std::nullopt for the first page.
+ * @param limit The maximum number of likers to return.
+ * @param hedge Whether this is the hedge attempt of a hedged read.
+ * @return The page; its cursor is empty once the inbox has run out.
+ */
+static LikersPage fetchLikersFromInbox(mongocxx::collection& inbox_collection,
+                                       const std::string& entityId,
+                                       const std::optional<LikesCursor>& position,
+                                       size_t limit,
+                                       bool hedge) {
+    document filter{};
+    filter << "entityId" << entityId;
+    if (position) {
+        filter << "_id" << open_document << "$lte" << oid(position->lastId) << close_document;
+    }
+
+    static const auto newest_first = document{} << "_id" << -1 << finalize;
+    mongocxx::options::find opts;
+    opts.sort(newest_first.view());
+    opts.batch_size(static_cast<std::int32_t>(limit / kInboxBucketSize + 2));
+    withReadAttempt(opts, hedge);
+
+    LikersPage page;
+    for (auto&& bucket : inbox_collection.find(filter.view(), opts)) {
+        std::string bucketId = bucket["_id"].get_oid().value.to_string();
+
+        std::vector<bsoncxx::document::view> cards;
+        for (auto&& liker : bucket["likers"].get_array().value) {
+            cards.push_back(liker.get_document().value);
+        }
+        if (cards.empty()) continue;
+
+        // Likers are pushed in arrival order, so walk the bucket backwards for newest first.
+        // Array indexes stay stable while the bucket grows, which keeps the cursor valid.
+        int start = static_cast<int>(cards.size()) - 1;
+        if (position && bucketId == position->lastId) {
+            start = std::min(start, position->nextIndex);
+        }
+
+        for (int i = start; i >= 0; --i) {
+            if (page.likers.size() == limit) {
+                page.nextCursor = encodeLikesCursor({true, bucketId, i});
+                return page;
+            }
+            const auto& card = cards[i];
+            LikerRecord record;
+            record.id = std::string(card["id"].get_string().value);
+            record.username = card["username"] ? std::string(card["username"].get_string().value) : "";
+            record.popularity = card["popularity"] ? card["popularity"].get_double().value : 0.0;
+            // Cards pushed before they carried `matches` leave it unset
+            if (card["matches"]) record.matches = card["matches"].get_int32().value;
+            page.likers.push_back(std::move(record));
+        }
+    }
+    return page;
+}
+
+/**
+ * Reads likers from the entity's liked-by inbox, newest first, and once it runs out from the
+ * swipe documents created before the inbox went live (see likesInboxSince()), which still hold
+ * the likes recorded before it existed. Pages are idempotent reads, so they may be hedged.
+ */
+LikersPage MongoStorage::findLikers(EntityKind kind, const std::string& entityId, const std::string& cursor, size_t limit) {
+    std::optional<LikesCursor> position;
+    if (!cursor.empty()) {
+        position = decodeLikesCursor(cursor);
+        if (!position) throw std::invalid_argument("Invalid cursor.");
+    }
+
+    bool fromInbox = !position || position->fromInbox;
+    auto collection = fromInbox ? likesInboxCollectionName(kind) : swipeCollectionName(kind);
+    return hedgedRead("find", collection, [this, kind, entityId, position, limit, fromInbox](bool hedge) {
+        auto client = manager_.acquire();
+        auto& inbox_collection = likesInboxCollection(client, kind);
+        auto& swipe_collection = swipeCollection(client, kind);
+        auto& user_collection = client.getUserCollection();
+        const auto& since = likesInboxSince();
+        if (!fromInbox) {
+            if (!since) return LikersPage{};
+            return fetchLikersFromSwipes(swipe_collection, user_collection, inbox_collection, entityId, position->lastId, *since, limit, hedge);
+        }
+
+        auto page = fetchLikersFromInbox(inbox_collection, entityId, position, limit, hedge);
+        if (!page.nextCursor.empty() || !since) return page;
+
+        // The inbox ran out: fill the rest of the page from the swipe scan, which also says
+        // whether there is a next page even when the inbox filled this one exactly
+        auto tail = fetchLikersFromSwipes(swipe_collection, user_collection, inbox_collection, entityId,
+                                          kSwipeScanStart, *since, limit - page.likers.size(), hedge);
+        std::move(tail.likers.begin(), tail.likers.end(), std::back_inserter(page.likers));
+        page.nextCursor = std::move(tail.nextCursor);
+        return page;
+    });
+}
+
+// --- Readiness ---
+
+/**
+ * Creates the required indexes (unless DB_ENSURE_INDEXES=0), then checks that no hot query is
+ * planned as a collection scan. DB_PLAN_CHECK chooses what a scan does: "warn" (default) logs
+ * it, "fail" also keeps the service not ready, and "off" skips the check. If MongoDB cannot be
+ * reached while creating indexes, the check is skipped rather than waiting out another timeout.
+ */
+std::vector<std::string> MongoStorage::prepare() {
+    const char* mode = getenv("DB_PLAN_CHECK");
+    std::string planCheck = mode ? mode : "warn";
+
+    std::vector<std::string> problems;
+    if (envInt("DB_ENSURE_INDEXES", 1)) {
+        try {
+            manager_.ensureIndexes();
+        } catch (const std::exception& e) {
+            std::cerr << "Could not create indexes: " << e.what() << std::endl;
+            problems.push_back("Could not create indexes: " + std::string(e.what()));
+        }
+    }
+    if (planCheck == "off") return {};
+    if (!problems.empty()) return planCheck == "fail" ? problems : std::vector<std::string>{};
+
+    try {
+        for (auto& scan : manager_.findCollectionScans()) {
+            std::cerr << "Query plan is a collection scan: " << scan << std::endl;
+            problems.push_back("Collection scan: " + scan);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Could not verify query plans: " << e.what() << std::endl;
+        problems.push_back("Could not verify query plans: " + std::string(e.what()));
+    }
+    if (planCheck != "fail") return {};
+    return problems;
+}
+
+// --- Counters ---
+
+/**
+ * Applies each delta with a single $inc that returns the updated counters, followed by
+ * one popularity write. Once the $inc is acknowledged the delta is zeroed, so if the
+ * popularity write fails the retry recomputes popularity without adding the counters again.
+ */
+void MongoStorage::applyCounterDeltas(EntityKind kind, CounterDeltaMap& deltas, std::vector<EntityCity>& changed) {
+    auto client = manager_.acquire();
+    auto& entity_collection = entityCollection(client, kind);
+
+    static const auto counters_projection =
+        document{} << "swipesReceived" << 1 << "swipesMade" << 1 << "matches" << 1 << "budget" << 1
+                   << "country" << 1 << "city" << 1 << finalize;
+    mongocxx::options::find_one_and_update opts;
+    opts.return_document(mongocxx::options::return_document::k_after);
+    opts.projection(counters_projection.view());
+
+    for (auto it = deltas.begin(); it != deltas.end();) {
+        withDeadline(opts);
+        auto& [entityId, delta] = *it;
+        BsonFilter filter;
+        filter.append("_id", oid(entityId));
+        auto maybe_entity = entity_collection.find_one_and_update(
+            filter.view(),
+            document{}
+                << "$inc" << open_document
+                    << "swipesReceived" << delta.swipesReceived
+                    << "swipesMade" << delta.swipesMade
+                    << "matches" << delta.matches
+                << close_document
+                << finalize,
+            opts);
+
+        if (!maybe_entity) {
+            std::cerr << "Entity not found: " << entityId << std::endl;
+            it = deltas.erase(it);
+            continue;
+        }
+
+        delta = CounterDelta{};
+        auto counters = decodeBson<PopularityCounters>(maybe_entity->view());
+        double budget = parseBudget(std::string(counters.budget));
+        changed.push_back({std::string(counters.country), std::string(counters.city)});
+
+        entity_collection.update_one(
+            filter.view(),
+            document{}
+                << "$set" << open_document
+                    << "popularity" << calculatePopularity(counters.swipesReceived, counters.swipesMade, counters.matches, budget)
+                << close_document
+                << finalize);
+        it = deltas.erase(it);
+    }
+}
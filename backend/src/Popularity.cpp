@@ -0,0 +1,65 @@
+#include "Popularity.h"
+
+#include <algorithm>
+
+/**
+ * Normalizes a budget value to a range of 0.0 to 1.0.
+ * @param budget The budget value to normalize.
+ * @return A normalized budget value between 0.0 and 1.0.
+ */
+// TODO: Adjust the min and max budget values
+double normalizeBudget(double budget) {
+    double minBudget = 500.0;
+    double maxBudget = 100000.0;
+    return (budget - minBudget) / (maxBudget - minBudget); // Result: 0.0 to 1.0
+}
+
+/**
+ * Normalizes a popularity score to a range of 0.0 to 1.0.
+ * @param popularity The raw popularity score.
+ * @param minPopularity The minimum possible popularity score.
+ * @param maxPopularity The maximum possible popularity score.
+ * @return A normalized popularity score between 0.0 and 1.0.
+ */
+double normalizePopularity(double popularity, double minPopularity, double maxPopularity) {
+    if (maxPopularity == minPopularity) return 0.0;
+    return std::max(0.0, std::min(1.0, (popularity - minPopularity) / (maxPopularity - minPopularity)));
+}
+
+/**
+ * Calculates a popularity score based on various factors.
+ * @param received Number of swipes received.
+ * @param made Number of swipes made.
+ * @param matches Number of matches.
+ * @param budget The budget of the entity.
+ * @return A calculated popularity score.
+ */
+double calculatePopularity(int received, int made, int matches, double budget) {
+    // Adjust weights for each factor based on their importance
+    // TODO: Train the data based on data to a machine learning model for a popularity score
+    double w_received = 1.0;
+    double w_made = -0.5;
+    double w_matches = 2.0;
+    double w_budget = 0.2;
+    double normalizedBudget = normalizeBudget(budget);
+
+    return w_received * received
+         + w_made * made
+         + w_matches * matches
+         + w_budget * normalizedBudget;
+}
+
+/**
+ * Parses a stored budget string such as "$1200" or "1200.50".
+ * @param budget The budget string.
+ * @return The budget value, or 0.0 if it can't be parsed.
+ */
+double parseBudget(std::string budget) {
+    try {
+        // Remove $ if present
+        if (!budget.empty() && budget[0] == '$') budget = budget.substr(1);
+        return std::stod(budget);
+    } catch (...) {
+        return 0.0;
+    }
+}
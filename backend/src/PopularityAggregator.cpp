@@ -0,0 +1,158 @@
+#include "PopularityAggregator.h"
+#include "ETag.h"
+#include "EntityCardCache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+PopularityAggregator::PopularityAggregator(std::chrono::milliseconds flushInterval)
+    // A zero interval would make the flusher spin, locking every shard on each pass
+    : flushInterval_(std::max(flushInterval, std::chrono::milliseconds(1))) {
+    flusher_ = std::thread([this] { run(); });
+}
+
+PopularityAggregator::~PopularityAggregator() {
+    stop();
+}
+
+void PopularityAggregator::recordSwipeReceived(EntityKind kind, const std::string& entityId) {
+    auto& shard = localShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    localDelta(kind, entityId).swipesReceived++;
+}
+
+void PopularityAggregator::recordSwipeMade(EntityKind kind, const std::string& entityId) {
+    auto& shard = localShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    localDelta(kind, entityId).swipesMade++;
+}
+
+void PopularityAggregator::recordMatch(EntityKind kind, const std::string& entityId) {
+    auto& shard = localShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    localDelta(kind, entityId).matches++;
+}
+
+/**
+ * Returns the calling thread's shard, registering it on first use.
+ * Shards are shared with the aggregator so deltas survive the thread exiting.
+ */
+PopularityAggregator::Shard& PopularityAggregator::localShard() {
+    thread_local std::shared_ptr<Shard> shard;
+    if (!shard) {
+        shard = std::make_shared<Shard>();
+        std::lock_guard<std::mutex> lock(shardsMutex_);
+        shards_.push_back(shard);
+    }
+    return *shard;
+}
+
+// Caller must hold the local shard's mutex
+PopularityAggregator::Delta& PopularityAggregator::localDelta(EntityKind kind, const std::string& entityId) {
+    auto& shard = localShard();
+    auto& deltas = (kind == EntityKind::User) ? shard.users : shard.rooms;
+    return deltas[entityId];
+}
+
+void PopularityAggregator::mergeDeltas(DeltaMap& into, DeltaMap& from) {
+    for (auto& [entityId, delta] : from) {
+        auto& merged = into[entityId];
+        merged.swipesReceived += delta.swipesReceived;
+        merged.swipesMade += delta.swipesMade;
+        merged.matches += delta.matches;
+    }
+}
+
+void PopularityAggregator::flush() {
+    std::lock_guard<std::mutex> flushLock(flushMutex_);
+
+    std::vector<std::shared_ptr<Shard>> shards;
+    {
+        std::lock_guard<std::mutex> lock(shardsMutex_);
+        shards = shards_;
+    }
+
+    // Swap each shard out under its lock so recording threads are blocked only for the swap
+    for (auto& shard : shards) {
+        DeltaMap users, rooms;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            users.swap(shard->users);
+            rooms.swap(shard->rooms);
+        }
+        mergeDeltas(pendingUsers_, users);
+        mergeDeltas(pendingRooms_, rooms);
+    }
+
+    flushKind(EntityKind::User, pendingUsers_);
+    flushKind(EntityKind::Room, pendingRooms_);
+}
+
+/**
+ * Applies the folded deltas of one entity kind. Deltas that fail stay in `deltas`
+ * and are retried on the next flush.
+ * @param kind Whether the deltas belong to users or rooms.
+ * @param deltas The pending deltas, keyed by entity id.
+ */
+void PopularityAggregator::flushKind(EntityKind kind, DeltaMap& deltas) {
+    if (deltas.empty()) return;
+
+    // applyCounterDeltas() erases what it applies, so note the ids first
+    std::vector<std::string> ids;
+    ids.reserve(deltas.size());
+    for (const auto& entry : deltas) {
+        ids.push_back(entry.first);
+    }
+
+    std::vector<EntityCity> changed;
+    try {
+        getStorage().applyCounterDeltas(kind, deltas, changed);
+    } catch (const std::exception& e) {
+        // Keep the remaining deltas for the next flush rather than hammering a failing server
+        std::cerr << "Error flushing popularity deltas: " << e.what() << std::endl;
+    }
+
+    // Popularity is on the cached cards; dropping a card whose write failed only costs a miss
+    auto& cards = getEntityCardCache();
+    for (const auto& id : ids) {
+        cards.invalidate(kind, id);
+    }
+    // Only the recommendations listing these entities changed
+    for (const auto& location : changed) {
+        bumpRankingVersion(kind, location.country, location.city);
+    }
+}
+
+void PopularityAggregator::run() {
+    std::unique_lock<std::mutex> lock(stopMutex_);
+    while (!stopping_) {
+        stopCv_.wait_for(lock, flushInterval_, [this] { return stopping_; });
+        if (stopping_) break;
+
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void PopularityAggregator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        stopping_ = true;
+    }
+    stopCv_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+        flush();
+    }
+}
+
+PopularityAggregator& getPopularityAggregator() {
+    // Construct the storage and card cache first so they outlive the aggregator's final flush
+    getStorage();
+    getEntityCardCache();
+    static PopularityAggregator aggregator(std::chrono::milliseconds(std::max(1,
+        getenv("POPULARITY_FLUSH_MS") ? std::atoi(getenv("POPULARITY_FLUSH_MS")) : 1000)));
+    return aggregator;
+}
@@ -1,9 +1,10 @@
 #include "Recommender.h"
-#include "DBManager.h"
+#include "JsonWriter.h"
 #include "Profile.h"
+#include "RequestTrace.h"
+#include "Storage.h"
 
 #include <crow/crow_all.h>
-#include <bsoncxx/oid.hpp>
 #include <cmath>
 #include <algorithm>
 #include <unordered_map>
@@ -11,16 +12,14 @@
 #include <regex>
 
 
-using mongocxx::collection;
-
-
 /**
  * Tokenizes a string into words, converting them to lowercase.
  * @param text The input string to tokenize.
  */
-static std::vector<std::string> tokenize(const std::string& text) {
+std::vector<std::string> tokenize(const std::string& text) {
     std::vector<std::string> out;
-    std::regex re(R"(\w+)");
+    // Compiled once; matching against a const regex is thread-safe
+    static const std::regex re(R"(\w+)");
     for (auto it = std::sregex_iterator(text.begin(), text.end(), re);
          it != std::sregex_iterator(); ++it) {
         std::string w = it->str();
@@ -30,6 +29,16 @@ static std::vector<std::string> tokenize(const std::string& text) {
     return out;
 }
 
+void tokenizeProfile(Profile& profile) {
+    // TODO - Cap the number of tokens to more recent ones using timestamps
+    // TODO - Add preferences and interests to the recommender system
+    std::string all = profile.city + " " +
+                      profile.state + " " +
+                      profile.country + " " +
+                      profile.zipcode + " " +
+                      profile.budget;
+    profile.tokens = tokenize(all);
+}
 
 
 /**
@@ -142,17 +151,22 @@ static std::vector<std::pair<double, int>> cosineSimilarity(
  * @param maxResults The maximum number of results to return.
  * @return A JSON object containing ranked user recommendations.
  */
-crow::json::wvalue rankUsers(const std::string& targetId,
-                             const std::string& type,
-                             size_t maxResults) {
+std::string rankUsers(const std::string& targetId,
+                      const std::string& type,
+                      size_t maxResults) {
     // As of now, the recommender system only supports roommate type
     if (type != "roommate") {
         throw std::invalid_argument("Invalid type, expected 'roommate'");
     }
 
-    auto profiles = fetchUserData();
+    std::vector<Profile> profiles;
+    {
+        StageTimer timer(Stage::DbFetch);
+        profiles = getStorage().loadProfiles();
+    }
     size_t N_Docs = profiles.size();
 
+    StageTimer scoringTimer(Stage::Scoring);
     auto norm = normalizeVector(TF_IDF(profiles));
 
     // Target Idex
@@ -169,25 +183,33 @@ crow::json::wvalue rankUsers(const std::string& targetId,
     }
 
     auto similarities = cosineSimilarity(V, norm, targetIndex);
-    std::sort(similarities.begin(), similarities.end(), [](auto &a, auto &b){ return a.first > b.first; });
+    scoringTimer.stop();
+
+    {
+        StageTimer timer(Stage::TopK);
+        std::sort(similarities.begin(), similarities.end(), [](auto &a, auto &b){ return a.first > b.first; });
+    }
 
-    crow::json::wvalue result;
-    result["recommendations"] = crow::json::wvalue::list();
-    for (size_t idx=0; idx<std::min(maxResults, similarities.size()); ++idx) {
+    StageTimer serializeTimer(Stage::Serialize);
+    size_t count = std::min(maxResults, similarities.size());
+    JsonWriter json(32 + count * 192);
+    json.beginObject().key("recommendations").beginArray();
+    for (size_t idx=0; idx<count; ++idx) {
         auto [score,i] = similarities[idx];
-        crow::json::wvalue obj;
-        obj["userId"]   = profiles[i].id;
-        obj["city"]     = profiles[i].city;
-        obj["state"]    = profiles[i].state;
-        obj["country"]  = profiles[i].country;
-        obj["zipcode"]  = profiles[i].zipcode;
-        obj["budget"]   = profiles[i].budget;
-        obj["score"]    = score;
-        result["recommendations"][idx] = std::move(obj);
+        json.beginObject();
+        json.field("userId",  profiles[i].id);
+        json.field("city",    profiles[i].city);
+        json.field("state",   profiles[i].state);
+        json.field("country", profiles[i].country);
+        json.field("zipcode", profiles[i].zipcode);
+        json.field("budget",  profiles[i].budget);
+        json.field("score",   score);
+        json.endObject();
 
         // TODO - Add more user information like preferences, interests, etc.
         // TODO - Sort by popularity as well
     }
+    json.endArray().endObject();
 
-    return result;
+    return json.release();
 }
\ No newline at end of file
@@ -0,0 +1,284 @@
+// Batch job that recomputes the popularity score of every user and room, e.g. after the
+// weights in calculatePopularity() change.
+//
+// Usage: recompute_popularity [--threads N] [--ops-per-sec N] [--batch-size N]
+//
+// Documents are streamed with a projection of the scoring fields, scored on a pool of
+// worker threads and written back with unordered bulk writes, paced to --ops-per-sec so a
+// full recompute does not starve online traffic.
+
+#include "Popularity.h"
+#include "Records.h"
+
+#include <bsoncxx/builder/stream/document.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/options/bulk_write.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/pool.hpp>
+#include <mongocxx/uri.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using bsoncxx::builder::stream::document;
+using bsoncxx::builder::stream::finalize;
+using bsoncxx::builder::stream::open_document;
+using bsoncxx::builder::stream::close_document;
+
+/**
+ * Paces callers to a fixed number of operations per second across all threads.
+ * Each caller reserves the next time slot for its operations and sleeps until it starts.
+ */
+class RateLimiter {
+public:
+    explicit RateLimiter(double opsPerSec) : opsPerSec_(opsPerSec) {}
+
+    void acquire(size_t ops) {
+        if (opsPerSec_ <= 0) return;
+
+        auto cost = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(ops / opsPerSec_));
+        std::chrono::steady_clock::time_point start;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto now = std::chrono::steady_clock::now();
+            if (next_ < now) next_ = now;
+            start = next_;
+            next_ += cost;
+        }
+        std::this_thread::sleep_until(start);
+    }
+
+private:
+    double opsPerSec_;
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point next_{};
+};
+
+/**
+ * Bounded hand-off between the reading thread and the workers. Blocks the reader when the
+ * workers fall behind so memory stays proportional to the queue capacity.
+ */
+class BatchQueue {
+public:
+    explicit BatchQueue(size_t capacity) : capacity_(capacity) {}
+
+    void push(std::vector<bsoncxx::document::value> batch) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return batches_.size() < capacity_; });
+        batches_.push_back(std::move(batch));
+        notEmpty_.notify_one();
+    }
+
+    std::optional<std::vector<bsoncxx::document::value>> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return !batches_.empty() || closed_; });
+        if (batches_.empty()) return std::nullopt;
+
+        auto batch = std::move(batches_.front());
+        batches_.pop_front();
+        notFull_.notify_one();
+        return batch;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_, notFull_;
+    std::deque<std::vector<bsoncxx::document::value>> batches_;
+    bool closed_ = false;
+};
+
+struct RecomputeOptions {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    double opsPerSec = 5000;
+    int batchSize = 1000;
+};
+
+struct RecomputeStats {
+    std::atomic<size_t> scanned{0};
+    std::atomic<size_t> updated{0};
+    std::atomic<size_t> errors{0};
+};
+
+/**
+ * Scores one batch and writes back the entities whose popularity changed.
+ * @param collection The collection the batch was read from.
+ * @param batch The projected documents.
+ * @param limiter The shared write pacing.
+ * @param stats The counters to update.
+ */
+static void recomputeBatch(mongocxx::collection& collection,
+                           const std::vector<bsoncxx::document::value>& batch,
+                           RateLimiter& limiter,
+                           RecomputeStats& stats) {
+    mongocxx::options::bulk_write opts;
+    opts.ordered(false);
+    auto bulk = collection.create_bulk_write(opts);
+    size_t ops = 0;
+
+    for (const auto& value : batch) {
+        auto counters = decodeBson<PopularityCounters>(value.view());
+        if (!counters.id) continue;
+
+        double budget = parseBudget(std::string(counters.budget));
+        double popularity = calculatePopularity(counters.swipesReceived, counters.swipesMade, counters.matches, budget);
+        if (counters.popularity == popularity) continue;
+
+        bulk.append(mongocxx::model::update_one(
+            document{} << "_id" << *counters.id << finalize,
+            document{} << "$set" << open_document << "popularity" << popularity << close_document << finalize));
+        ++ops;
+    }
+
+    if (ops == 0) return;
+    limiter.acquire(ops);
+    bulk.execute();
+    stats.updated += ops;
+}
+
+/**
+ * Recomputes the popularity of every document in a collection.
+ * @param pool The client pool shared by the reader and the workers.
+ * @param collectionName The collection to recompute ("users" or "rooms").
+ * @param options The job options.
+ * @param limiter The shared write pacing.
+ * @param stats The counters to update.
+ */
+static void recomputeCollection(mongocxx::pool& pool,
+                                const std::string& collectionName,
+                                const RecomputeOptions& options,
+                                RateLimiter& limiter,
+                                RecomputeStats& stats) {
+    BatchQueue queue(options.threads * 2);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < options.threads; ++i) {
+        workers.emplace_back([&] {
+            auto client = pool.acquire();
+            auto collection = (*client)["roommatefinder"][collectionName];
+            while (auto batch = queue.pop()) {
+                try {
+                    recomputeBatch(collection, *batch, limiter, stats);
+                } catch (const std::exception& e) {
+                    std::cerr << "Error writing " << collectionName << " batch: " << e.what() << std::endl;
+                    stats.errors++;
+                }
+            }
+        });
+    }
+
+    try {
+        auto client = pool.acquire();
+        auto collection = (*client)["roommatefinder"][collectionName];
+
+        mongocxx::options::find opts;
+        opts.projection(document{}
+            << "swipesReceived" << 1 << "swipesMade" << 1 << "matches" << 1
+            << "budget" << 1 << "popularity" << 1
+            << finalize);
+        opts.batch_size(options.batchSize);
+
+        std::vector<bsoncxx::document::value> batch;
+        batch.reserve(options.batchSize);
+        for (auto&& doc : collection.find({}, opts)) {
+            batch.emplace_back(doc);
+            stats.scanned++;
+            if (batch.size() == static_cast<size_t>(options.batchSize)) {
+                queue.push(std::move(batch));
+                batch = {};
+                batch.reserve(options.batchSize);
+            }
+        }
+        if (!batch.empty()) queue.push(std::move(batch));
+    } catch (const std::exception& e) {
+        std::cerr << "Error reading " << collectionName << ": " << e.what() << std::endl;
+        stats.errors++;
+    }
+
+    queue.close();
+    for (auto& worker : workers) worker.join();
+}
+
+/**
+ * Raises the connection string's maxPoolSize to at least `clients`, adding it if unset.
+ * @param uri The MongoDB connection string.
+ * @param clients The number of clients held at the same time.
+ * @return The connection string.
+ */
+static std::string withMinPoolSize(std::string uri, size_t clients) {
+    static const std::string key = "maxPoolSize=";
+    auto found = uri.find(key);
+    if (found != std::string::npos) {
+        auto value = found + key.size();
+        auto end = std::min(uri.find('&', value), uri.size());
+        if (std::strtoul(uri.substr(value, end - value).c_str(), nullptr, 10) >= clients) return uri;
+        return uri.replace(value, end - value, std::to_string(clients));
+    }
+
+    auto query = uri.find('?');
+    if (query == std::string::npos) {
+        // Options need a "/" between the host list and the "?"
+        auto hosts = uri.find("://");
+        if (uri.find('/', hosts == std::string::npos ? 0 : hosts + 3) == std::string::npos) uri += '/';
+        uri += '?';
+    } else if (uri.back() != '?' && uri.back() != '&') {
+        uri += '&';
+    }
+    return uri + key + std::to_string(clients);
+}
+
+int main(int argc, char** argv) {
+    RecomputeOptions options;
+    for (int i = 1; i < argc; i += 2) {
+        bool hasValue = i + 1 < argc;
+        if (hasValue && std::strcmp(argv[i], "--threads") == 0) options.threads = std::max(1, std::atoi(argv[i + 1]));
+        else if (hasValue && std::strcmp(argv[i], "--ops-per-sec") == 0) options.opsPerSec = std::atof(argv[i + 1]);
+        else if (hasValue && std::strcmp(argv[i], "--batch-size") == 0) options.batchSize = std::max(1, std::atoi(argv[i + 1]));
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--threads N] [--ops-per-sec N] [--batch-size N]\n";
+            return 1;
+        }
+    }
+
+    mongocxx::instance inst{};
+    // The reader and every worker hold a client at the same time
+    std::string uri = getenv("MONGODB_URI") ? getenv("MONGODB_URI") : "mongodb://localhost:27017";
+    mongocxx::pool pool(mongocxx::uri{withMinPoolSize(uri, options.threads + 1)});
+    RateLimiter limiter(options.opsPerSec);
+
+    auto start = std::chrono::steady_clock::now();
+    bool failed = false;
+    for (const std::string collectionName : {"users", "rooms"}) {
+        RecomputeStats stats;
+        recomputeCollection(pool, collectionName, options, limiter, stats);
+
+        std::cout << collectionName << ": scanned " << stats.scanned
+                  << ", updated " << stats.updated
+                  << ", errors " << stats.errors << "\n";
+        failed = failed || stats.errors > 0;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Popularity recompute finished in " << elapsed.count() << "s\n";
+    return failed ? 1 : 0;
+}
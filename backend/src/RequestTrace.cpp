@@ -0,0 +1,88 @@
+#include "RequestTrace.h"
+
+#include "JsonWriter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+// Longest client-supplied request id that is kept
+static constexpr size_t kMaxRequestIdLength = 64;
+
+static thread_local std::shared_ptr<RequestTrace> threadTrace;
+
+static std::chrono::nanoseconds slowRequestThreshold() {
+    static const std::chrono::nanoseconds threshold = std::chrono::milliseconds(
+        std::max(0, getenv("SLOW_REQUEST_MS") ? std::atoi(getenv("SLOW_REQUEST_MS")) : 500));
+    return threshold;
+}
+
+const char* stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Parse: return "parse";
+        case Stage::Queue: return "queue";
+        case Stage::DbFetch: return "db";
+        case Stage::Scoring: return "score";
+        case Stage::TopK: return "topk";
+        case Stage::Serialize: return "serialize";
+    }
+    return "unknown";
+}
+
+/// True if a client-supplied id is safe to echo in headers and logs.
+static bool isUsableRequestId(const std::string& id) {
+    if (id.empty() || id.size() > kMaxRequestIdLength) return false;
+    return std::all_of(id.begin(), id.end(), [](unsigned char c) {
+        return std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == ':';
+    });
+}
+
+std::string makeRequestId(const std::string& requested) {
+    if (isUsableRequestId(requested)) return requested;
+
+    // A random prefix per process keeps ids from different replicas and restarts apart
+    static const uint32_t prefix = std::random_device{}();
+    static std::atomic<uint64_t> sequence{0};
+    char id[32];
+    std::snprintf(id, sizeof(id), "%08x-%llx", prefix, static_cast<unsigned long long>(++sequence));
+    return id;
+}
+
+const std::shared_ptr<RequestTrace>& currentRequestTrace() {
+    return threadTrace;
+}
+
+void setCurrentRequestTrace(std::shared_ptr<RequestTrace> trace) {
+    threadTrace = std::move(trace);
+}
+
+RequestTraceScope::RequestTraceScope(std::shared_ptr<RequestTrace> trace) : saved_(std::move(threadTrace)) {
+    threadTrace = std::move(trace);
+}
+
+RequestTraceScope::~RequestTraceScope() {
+    threadTrace = std::move(saved_);
+}
+
+void logIfSlowRequest(const RequestTrace& trace, const char* method, const std::string& route, int status,
+                      std::chrono::nanoseconds total) {
+    auto threshold = slowRequestThreshold();
+    if (threshold.count() <= 0 || total < threshold) return;
+
+    JsonWriter json(256);
+    json.beginObject();
+    json.field("slowRequest", trace.id);
+    json.field("method", method);
+    json.field("route", route);
+    json.field("status", status);
+    json.field("totalMs", total.count() / 1e6);
+    json.key("stagesMs").beginObject();
+    for (size_t i = 0; i < kStageCount; ++i) {
+        int64_t nanos = trace.nanos[i].load(std::memory_order_relaxed);
+        if (nanos > 0) json.field(stageName(static_cast<Stage>(i)), nanos / 1e6);
+    }
+    json.endObject().endObject();
+    std::cerr << json.str() << std::endl;
+}
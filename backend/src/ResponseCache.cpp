@@ -0,0 +1,173 @@
+#include "ResponseCache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+static std::chrono::milliseconds envTtl(const char* name, int fallbackMs) {
+    const char* value = getenv(name);
+    return std::chrono::milliseconds(std::max(0, value ? std::atoi(value) : fallbackMs));
+}
+
+const ResponseCacheTtls& getResponseCacheTtls() {
+    static const ResponseCacheTtls ttls{
+        envTtl("RESPONSE_CACHE_RECOMMEND_TTL_MS", 5000),
+        envTtl("RESPONSE_CACHE_LIKES_TTL_MS", 2000),
+        // Rankings are too large to keep, but concurrent ones are worth sharing
+        envTtl("RESPONSE_CACHE_RANK_TTL_MS", 0),
+    };
+    return ttls;
+}
+
+ResponseCache::ResponseCache(size_t capacity, size_t shardCount)
+    : shardCapacity_(capacity == 0 ? 0 : (capacity + shardCount - 1) / shardCount) {
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+static size_t variantIndex(ContentEncoding encoding) {
+    return encoding == ContentEncoding::Gzip ? 0 : 1;
+}
+
+/// The body compressed for `encoding`, or an empty string if the policy leaves it uncompressed.
+static std::string compressVariant(const std::string& body, ContentEncoding encoding, const CompressionPolicy& compression) {
+    crow::response compressed(body);
+    compressResponse(compressed, encoding, compression);
+    return compressed.get_header_value("Content-Encoding").empty() ? std::string() : std::move(compressed.body);
+}
+
+ResponseCache::Shard& ResponseCache::shardFor(const std::string& key) {
+    return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+ResponseCache::Lookup ResponseCache::lookup(const std::string& key, const Waiter& waiter) {
+    auto& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        if (Clock::now() < it->second->second->expires) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            hits_++;
+            return {it->second->second, false};
+        }
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    auto& waiters = shard.inFlight[key];
+    waiters.push_back(waiter);
+    if (waiters.size() > 1) {
+        coalesced_++;
+        return {nullptr, false};
+    }
+    misses_++;
+    return {nullptr, true};
+}
+
+void ResponseCache::complete(const std::string& key, crow::response result, std::chrono::milliseconds ttl, const CompressionPolicy& compression) {
+    auto entry = std::make_shared<Entry>();
+    entry->code = result.code;
+    entry->headers = std::move(result.headers);
+    // The timings describe the run that built the response, not the requests served from it
+    entry->headers.erase("Server-Timing");
+    entry->body = std::move(result.body);
+    entry->expires = Clock::now() + ttl;
+    bool cacheable = entry->code == 200 && ttl.count() > 0 && shardCapacity_ > 0;
+    auto& shard = shardFor(key);
+
+    // Compress here, off the io threads: every encoding if the entry will serve hits, else only
+    // the ones queued waiters asked for. A waiter queued after this is served uncompressed.
+    if (compression.level > 0) {
+        bool wanted[2] = {cacheable, cacheable};
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.inFlight.find(key);
+            if (it != shard.inFlight.end()) {
+                for (const auto& waiter : it->second) {
+                    if (waiter.encoding != ContentEncoding::Identity) wanted[variantIndex(waiter.encoding)] = true;
+                }
+            }
+        }
+        for (auto encoding : {ContentEncoding::Gzip, ContentEncoding::Deflate}) {
+            if (wanted[variantIndex(encoding)]) {
+                entry->variants[variantIndex(encoding)] = compressVariant(entry->body, encoding, compression);
+            }
+        }
+    }
+
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.inFlight.find(key);
+        if (it != shard.inFlight.end()) {
+            waiters = std::move(it->second);
+            shard.inFlight.erase(it);
+        }
+
+        if (cacheable) {
+            auto existing = shard.index.find(key);
+            if (existing != shard.index.end()) {
+                existing->second->second = entry;
+                shard.lru.splice(shard.lru.begin(), shard.lru, existing->second);
+            } else {
+                shard.lru.emplace_front(key, entry);
+                shard.index.emplace(key, shard.lru.begin());
+                if (shard.lru.size() > shardCapacity_) {
+                    shard.index.erase(shard.lru.back().first);
+                    shard.lru.pop_back();
+                }
+            }
+        }
+    }
+
+    for (const auto& waiter : waiters) {
+        auto response = respond(*entry, waiter.encoding, compression);
+        asio::post(*waiter.io_context, [res = waiter.res, response = std::move(response)]() mutable {
+            *res = std::move(response);
+            res->end();
+        });
+    }
+}
+
+crow::response ResponseCache::respond(const Entry& entry, ContentEncoding encoding, const CompressionPolicy& compression) {
+    crow::response res(entry.code);
+    res.headers = entry.headers;
+    if (compression.level > 0) res.add_header("Vary", "Accept-Encoding");
+
+    if (encoding != ContentEncoding::Identity && compression.level > 0) {
+        const auto& variant = entry.variants[variantIndex(encoding)];
+        if (!variant.empty()) {
+            res.body = variant;
+            res.set_header("Content-Encoding", contentEncodingName(encoding));
+            return res;
+        }
+    }
+    res.body = entry.body;
+    return res;
+}
+
+size_t ResponseCache::size() {
+    size_t total = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->lru.size();
+    }
+    return total;
+}
+
+ResponseCache& getResponseCache() {
+    static ResponseCache cache(static_cast<size_t>(std::max(0,
+        getenv("RESPONSE_CACHE_SIZE") ? std::atoi(getenv("RESPONSE_CACHE_SIZE")) : 10000)));
+    return cache;
+}
+
+std::string responseCacheKey(std::initializer_list<std::string_view> parts) {
+    std::string key;
+    for (auto part : parts) {
+        key.append(part.data(), part.size());
+        key += '\0';
+    }
+    return key;
+}
@@ -0,0 +1,61 @@
+#include "Storage.h"
+#include "MemoryStorage.h"
+#include "MongoStorage.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Builds the store selected by ROOMMATE_STORAGE.
+ * @throws std::runtime_error for an unknown backend or an unreadable fixture.
+ */
+static std::unique_ptr<Storage> makeStorage() {
+    std::string backend = getenv("ROOMMATE_STORAGE") ? getenv("ROOMMATE_STORAGE") : "mongo";
+    if (backend == "mongo") {
+        return std::make_unique<MongoStorage>(getDbManager());
+    }
+    if (backend == "memory") {
+        auto storage = std::make_unique<MemoryStorage>();
+        if (getenv("ROOMMATE_FIXTURE")) {
+            storage->loadFixture(getenv("ROOMMATE_FIXTURE"));
+        } else {
+            std::cerr << "ROOMMATE_STORAGE=memory without ROOMMATE_FIXTURE; starting empty" << std::endl;
+        }
+        return storage;
+    }
+    throw std::runtime_error("Unknown ROOMMATE_STORAGE '" + backend + "', expected 'mongo' or 'memory'");
+}
+
+std::vector<bool> Storage::recordSwipes(EntityKind targetKind, const std::string& sourceId, const std::vector<std::string>& targetIds) {
+    std::vector<bool> isNew;
+    isNew.reserve(targetIds.size());
+    for (const auto& targetId : targetIds) {
+        isNew.push_back(recordSwipe(targetKind, sourceId, targetId));
+    }
+    return isNew;
+}
+
+std::vector<std::string> Storage::findSwipersOf(EntityKind targetKind, const std::vector<std::string>& sourceIds, const std::string& targetId) {
+    std::vector<std::string> swipers;
+    for (const auto& sourceId : sourceIds) {
+        if (hasSwiped(targetKind, sourceId, targetId)) swipers.push_back(sourceId);
+    }
+    return swipers;
+}
+
+std::vector<bool> Storage::recordLikes(EntityKind targetKind, const std::string& likerId, const std::vector<std::string>& targetIds) {
+    std::vector<bool> listed;
+    listed.reserve(targetIds.size());
+    for (const auto& targetId : targetIds) {
+        listed.push_back(recordLike(targetKind, likerId, targetId));
+    }
+    return listed;
+}
+
+Storage& getStorage() {
+    static std::unique_ptr<Storage> storage = makeStorage();
+    return *storage;
+}
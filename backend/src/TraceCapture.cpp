@@ -0,0 +1,145 @@
+#include "TraceCapture.h"
+
+#include "JsonWriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// One thread's events. Only its thread writes it, and only while `busy` is set and a capture
+// is armed, so once a capture is disarmed and `busy` is clear the buffer can be read.
+struct TraceBuffer {
+    TraceBuffer(size_t capacity, uint32_t thread) : events(capacity), thread(thread) {}
+
+    std::vector<TraceEvent> events;
+    uint32_t thread;
+    uint64_t generation = 0;  // The capture the events belong to
+    uint64_t head = 0;        // Events recorded in that capture, including overwritten ones
+    std::atomic<bool> busy{false};
+};
+
+} // namespace
+
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+static std::atomic<uint64_t> captureGeneration{0};
+
+static size_t bufferCapacity() {
+    static const size_t capacity = static_cast<size_t>(std::max(1024,
+        getenv("TRACE_BUFFER_EVENTS") ? std::atoi(getenv("TRACE_BUFFER_EVENTS")) : 16384));
+    return capacity;
+}
+
+static TraceBuffer& threadBuffer() {
+    // Buffers outlive their thread so a capture keeps the events of threads that exited
+    thread_local TraceBuffer* buffer = [] {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<TraceBuffer>(bufferCapacity(), static_cast<uint32_t>(buffers.size() + 1)));
+        return buffers.back().get();
+    }();
+    return *buffer;
+}
+
+static int64_t sinceEpoch(TraceClock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static void record(char phase, const char* category, std::string_view name, int64_t startNanos, int64_t durationNanos, uint64_t id) {
+    auto& buffer = threadBuffer();
+    // Seen by finishTraceCapture() before it reads the buffer, or this sees the capture disarmed
+    buffer.busy.store(true);
+    if (traceCaptureActive.load()) {
+        uint64_t generation = captureGeneration.load();
+        if (buffer.generation != generation) {
+            buffer.generation = generation;
+            buffer.head = 0;
+        }
+        auto& event = buffer.events[buffer.head++ % buffer.events.size()];
+        size_t length = std::min(name.size(), sizeof(event.name) - 1);
+        std::memcpy(event.name, name.data(), length);
+        event.name[length] = '\0';
+        event.category = category;
+        event.startNanos = startNanos;
+        event.durationNanos = durationNanos;
+        event.id = id;
+        event.thread = buffer.thread;
+        event.phase = phase;
+    }
+    buffer.busy.store(false, std::memory_order_release);
+}
+
+void traceComplete(const char* category, std::string_view name, TraceClock::time_point start, TraceClock::duration duration) {
+    record('X', category, name, sinceEpoch(start), std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0);
+}
+
+void traceAsyncBegin(const char* category, std::string_view name, uint64_t id) {
+    record('b', category, name, sinceEpoch(TraceClock::now()), 0, id);
+}
+
+void traceAsyncEnd(const char* category, std::string_view name, uint64_t id) {
+    record('e', category, name, sinceEpoch(TraceClock::now()), 0, id);
+}
+
+bool armTraceCapture() {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    if (traceCaptureActive.load()) return false;
+    // Threads pick the new generation up when they next record and drop their old events
+    captureGeneration++;
+    traceCaptureActive.store(true);
+    return true;
+}
+
+TraceSnapshot finishTraceCapture() {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    traceCaptureActive.store(false);
+    uint64_t generation = captureGeneration.load();
+
+    TraceSnapshot snapshot;
+    for (const auto& buffer : buffers) {
+        // Sequentially consistent, like the store above: a thread either finished its event or sees the capture disarmed
+        while (buffer->busy.load()) std::this_thread::yield();
+        if (buffer->generation != generation) continue;
+
+        uint64_t capacity = buffer->events.size();
+        uint64_t first = buffer->head > capacity ? buffer->head - capacity : 0;
+        snapshot.overwritten += first;
+        for (uint64_t i = first; i < buffer->head; ++i) {
+            snapshot.events.push_back(buffer->events[i % capacity]);
+        }
+    }
+    return snapshot;
+}
+
+std::string toChromeTraceJson(const TraceSnapshot& snapshot) {
+    JsonWriter json(256 + snapshot.events.size() * 128);
+    json.beginObject();
+    json.key("traceEvents").beginArray();
+    for (const auto& event : snapshot.events) {
+        char phase[2] = {event.phase, '\0'};
+        json.beginObject();
+        json.field("name", event.name);
+        json.field("cat", event.category);
+        json.field("ph", phase);
+        // Trace-event timestamps and durations are in microseconds
+        json.field("ts", event.startNanos / 1e3);
+        if (event.phase == 'X') json.field("dur", event.durationNanos / 1e3);
+        if (event.phase != 'X') {
+            char id[24];
+            std::snprintf(id, sizeof(id), "0x%llx", static_cast<unsigned long long>(event.id));
+            json.field("id", id);
+        }
+        json.field("pid", 1);
+        json.field("tid", event.thread);
+        json.endObject();
+    }
+    json.endArray();
+    json.field("displayTimeUnit", "ms");
+    json.key("otherData").beginObject().field("overwrittenEvents", snapshot.overwritten).endObject();
+    json.endObject();
+    return json.release();
+}
@@ -1,59 +1,330 @@
 #include "crow/crow_all.h"
+#include "AdminAuth.h"
+#include "BlockingExecutor.h"
+#include "Compression.h"
+#include "DBManager.h"
+#include "DbMetrics.h"
+#include "ETag.h"
+#include "EntityCardCache.h"
+#include "JsonWriter.h"
 #include "Matcher.h"
+#include "Metrics.h"
 #include "Recommender.h"
+#include "RequestTrace.h"
+#include "ResponseCache.h"
+#include "PopularityAggregator.h"
+#include "Storage.h"
+#include "TraceCapture.h"
+#include <mutex>
+#include <thread>
+#ifdef ROOMMATE_COROUTINES
+#include "AsyncDb.h"
+#endif
+
+// Longest capture /api/admin/trace will run
+static constexpr int kMaxTraceSeconds = 60;
+// Traces are large and repetitive, and fetched rarely
+static const CompressionPolicy kTraceCompression{6, 1024};
 
 int main() {
-    crow::SimpleApp app;
+    // MetricsMiddleware times every request for /metrics; AdminAuthMiddleware guards /api/admin/*
+    crow::App<MetricsMiddleware, AdminAuthMiddleware> app;
 
 
     CROW_ROUTE(app, "/")([](){
         return crow::response("Roommate Finder Backend is running.");
     });
 
+    // Handlers below validate on the io thread and hand the MongoDB work to the DB executor,
+    // so a slow query never stalls the other connections served by the same io thread.
+    // With ROOMMATE_COROUTINES the work runs in a coroutine that suspends on the executor instead.
+    // Each endpoint's deadline budget (Deadline.h) covers queueing and caps every query via maxTimeMS,
+    // and its compression policy (Compression.h) sets the zlib level of its responses.
+    // Polled reads carry an ETag (ETag.h) and answer a matching If-None-Match with 304 right here;
+    // they and the ranking go through the response cache (ResponseCache.h), which also merges
+    // identical requests that are in flight at the same time.
+
     // Get recommended roommates for a user
     CROW_ROUTE(app, "/api/recommend").methods("GET"_method)
-    ([](const crow::request& req){
+    ([](const crow::request& req, crow::response& res){
         auto type = req.url_params.get("type");
-        if (!type) return crow::response(400, "Missing type parameter.");
+        if (!type) { res.code = 400; return res.end("Missing type parameter."); }
         auto userId = req.url_params.get("userId");
-        if (!userId) return crow::response(400, "Missing userId parameter.");
+        if (!userId) { res.code = 400; return res.end("Missing userId parameter."); }
+
+        // Until the user's city is known the response can be neither tagged nor kept, only shared
+        auto kind = parseEntityType(type);
+        auto version = kind ? rankingVersion(*kind, userId) : std::nullopt;
+        std::string etag = version ? recommendationsETag(*kind, *version) : "";
+        if (answerNotModified(req, res, etag)) return;
+        auto key = responseCacheKey({"recommend", type, userId, version ? std::to_string(*version) : "-"});
+        auto ttl = version ? getResponseCacheTtls().recommend : std::chrono::milliseconds(0);
 
-        return crow::response(getRecommendations(userId, type));
+#ifdef ROOMMATE_COROUTINES
+        spawnCached(req, res, key, ttl,
+                    withETag(asyncGetRecommendations(userId, type), etag), getCompressionPolicies().recommend);
+#else
+        dispatchCached(req, res, key, ttl, getEndpointBudgets().recommend, getCompressionPolicies().recommend,
+                       [userId = std::string(userId), type = std::string(type), etag] {
+            auto response = jsonReadResponse(getRecommendations(userId, type));
+            setETag(response, etag);
+            return response;
+        });
+#endif
     });
 
     CROW_ROUTE(app, "/api/swipe").methods("POST"_method)
-    ([](const crow::request& req){
+    ([](const crow::request& req, crow::response& res){
+        StageTimer parseTimer(Stage::Parse);
+        auto body = crow::json::load(req.body);
+        if (!body) { res.code = 400; return res.end("Invalid JSON."); }
+
+        std::string type, sourceId, targetId;
+        bool isLike = false;
+        try {
+            type = body["type"].s();
+            sourceId = body["sourceId"].s();
+            targetId = body["targetId"].s();
+            isLike = body["isLike"].b();
+        } catch (const std::exception&) {
+            res.code = 400;
+            return res.end("Invalid swipe.");
+        }
+        parseTimer.stop();
+
+#ifdef ROOMMATE_COROUTINES
+        spawnHandler(req, res, asyncProcessSwipe(sourceId, targetId, type, isLike), getCompressionPolicies().swipe);
+#else
+        dispatchBlocking(req, res, getEndpointBudgets().swipe, getCompressionPolicies().swipe, [=] {
+            return crow::response(processSwipe(sourceId, targetId, type, isLike));
+        });
+#endif
+    });
+
+    // Many swipes in one request: {"swipes": [{"type", "sourceId", "targetId", "isLike"}, ...]}.
+    // Each swipe gets its own result, so one bad item does not fail the batch.
+    CROW_ROUTE(app, "/api/swipes").methods("POST"_method)
+    ([](const crow::request& req, crow::response& res){
+        StageTimer parseTimer(Stage::Parse);
         auto body = crow::json::load(req.body);
-        if (!body) return crow::response(400, "Invalid JSON.");
+        if (!body || body.t() != crow::json::type::Object || !body.has("swipes") || body["swipes"].t() != crow::json::type::List) {
+            res.code = 400;
+            return res.end("Invalid JSON.");
+        }
+        if (body["swipes"].size() > kMaxSwipeBatchSize) {
+            res.code = 400;
+            return res.end("Too many swipes; send at most " + std::to_string(kMaxSwipeBatchSize) + ".");
+        }
 
-        std::string type = body["type"].s();
-        std::string sourceId = body["sourceId"].s();
-        std::string targetId = body["targetId"].s();
-        bool isLike = body["isLike"].b();
-        return crow::response(processSwipe(sourceId, targetId, type, isLike));
+        std::vector<SwipeItem> swipes;
+        swipes.reserve(body["swipes"].size());
+        for (const auto& swipe : body["swipes"]) {
+            SwipeItem item;
+            try {
+                item.type = swipe["type"].s();
+                item.sourceId = swipe["sourceId"].s();
+                item.targetId = swipe["targetId"].s();
+                item.isLike = swipe["isLike"].b();
+            } catch (const std::exception&) {
+                item.malformed = true;
+            }
+            swipes.push_back(std::move(item));
+        }
+        parseTimer.stop();
+
+#ifdef ROOMMATE_COROUTINES
+        spawnHandler(req, res, asyncProcessSwipes(std::move(swipes)), getCompressionPolicies().swipes);
+#else
+        dispatchBlocking(req, res, getEndpointBudgets().swipes, getCompressionPolicies().swipes, [swipes = std::move(swipes)] {
+            return jsonResponse(processSwipes(swipes));
+        });
+#endif
     });
 
     CROW_ROUTE(app, "/api/likes").methods("GET"_method)
-    ([](const crow::request& req){
+    ([](const crow::request& req, crow::response& res){
         auto id = req.url_params.get("id");
         auto type = req.url_params.get("type");
-        if (!id || !type) return crow::response(400, "Missing id or type parameter.");
-        return crow::response(getUserWhoLikedEntity(id, type));
+        if (!id || !type) { res.code = 400; return res.end("Missing id or type parameter."); }
+
+        // Stream every liker as a chunked response instead of paging
+        auto stream = req.url_params.get("stream");
+        if (stream && std::string(stream) == "1") {
+            if (!parseEntityType(type)) { res.code = 400; return res.end(kInvalidTypeError); }
+            res.set_header("Content-Type", "application/json");
+            res.set_chunked_body(offloadChunks(getEndpointBudgets().likes, std::make_shared<LikesStream>(id, type)));
+            return res.end();
+        }
+
+        auto cursor = req.url_params.get("cursor");
+        auto limit = req.url_params.get("limit");
+        size_t pageSize = 50;
+        if (limit) {
+            try {
+                pageSize = std::stoul(limit);
+            } catch (...) {
+                res.code = 400;
+                return res.end("Invalid limit parameter.");
+            }
+        }
+
+        auto kind = parseEntityType(type);
+        std::string etag = kind ? likesETag(*kind, id) : "";
+        if (answerNotModified(req, res, etag)) return;
+        auto key = responseCacheKey({"likes", type, id, cursor ? cursor : "", std::to_string(pageSize),
+                                     std::to_string(kind ? likesVersion(*kind, id) : 0)});
+
+#ifdef ROOMMATE_COROUTINES
+        spawnCached(req, res, key, getResponseCacheTtls().likes,
+                    withETag(asyncGetUserWhoLikedEntity(id, type, cursor ? cursor : "", pageSize), etag), getCompressionPolicies().likes);
+#else
+        dispatchCached(req, res, key, getResponseCacheTtls().likes, getEndpointBudgets().likes, getCompressionPolicies().likes,
+                       [id = std::string(id), type = std::string(type), cursor = std::string(cursor ? cursor : ""), pageSize, etag] {
+            auto response = jsonReadResponse(getUserWhoLikedEntity(id, type, cursor, pageSize));
+            setETag(response, etag);
+            return response;
+        });
+#endif
+    });
+
+    // Prometheus scrape target
+    CROW_ROUTE(app, "/metrics").methods("GET"_method)
+    ([](){
+        crow::response res(renderPrometheusMetrics());
+        res.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+        return res;
+    });
+
+    // Captures ?seconds=N (default 5) of request, MongoDB command and handler stage spans and
+    // returns them as Chrome trace-event JSON, to open in Perfetto or chrome://tracing
+    CROW_ROUTE(app, "/api/admin/trace").methods("GET"_method)
+    ([](const crow::request& req, crow::response& res){
+        int seconds = req.url_params.get("seconds") ? std::atoi(req.url_params.get("seconds")) : 5;
+        if (seconds < 1 || seconds > kMaxTraceSeconds) {
+            res.code = 400;
+            return res.end("seconds must be between 1 and " + std::to_string(kMaxTraceSeconds) + ".");
+        }
+        if (!armTraceCapture()) {
+            res.code = 409;
+            return res.end("A trace capture is already running.");
+        }
+
+        auto timer = std::make_shared<asio::steady_timer>(*req.io_context, std::chrono::seconds(seconds));
+        timer->async_wait([timer, &req, &res](const asio::error_code&) {
+            // Stop recording here so the capture ends on time even if the JSON cannot be built
+            auto snapshot = std::make_shared<TraceSnapshot>(finishTraceCapture());
+            dispatchBlocking(req, res, std::chrono::milliseconds(0), kTraceCompression, [snapshot] {
+                auto response = jsonResponse(toChromeTraceJson(*snapshot));
+                response.set_header("Content-Disposition", "attachment; filename=\"roommate-trace.json\"");
+                return response;
+            });
+        });
+    });
+
+    // MongoDB client pool occupancy
+    CROW_ROUTE(app, "/api/admin/dbpool").methods("GET"_method)
+    ([](){
+        return crow::response(getDbPoolStats());
+    });
+
+    // DB executor occupancy
+    CROW_ROUTE(app, "/api/admin/executor").methods("GET"_method)
+    ([](){
+        auto& executor = getDbExecutor();
+        crow::json::wvalue result;
+        result["threads"] = executor.threadCount();
+        result["queueDepth"] = executor.queueDepth();
+        result["maxQueueDepth"] = executor.maxQueueDepth();
+        result["rejected"] = executor.rejected();
+        return crow::response(result);
+    });
+
+    // Entity card cache effectiveness
+    CROW_ROUTE(app, "/api/admin/cardcache").methods("GET"_method)
+    ([](){
+        auto& cache = getEntityCardCache();
+        crow::json::wvalue result;
+        result["size"] = cache.size();
+        result["hits"] = cache.hits();
+        result["misses"] = cache.misses();
+        return crow::response(result);
+    });
+
+    // Response cache effectiveness
+    CROW_ROUTE(app, "/api/admin/responsecache").methods("GET"_method)
+    ([](){
+        auto& cache = getResponseCache();
+        crow::json::wvalue result;
+        result["size"] = cache.size();
+        result["hits"] = cache.hits();
+        result["misses"] = cache.misses();
+        result["coalesced"] = cache.coalesced();
+        return crow::response(result);
+    });
+
+    // Response bytes saved by compression
+    CROW_ROUTE(app, "/api/admin/compression").methods("GET"_method)
+    ([](){
+        return crow::response(getCompressionStats());
+    });
+
+    // MongoDB command latency and round trips per request
+    CROW_ROUTE(app, "/api/admin/dbmetrics").methods("GET"_method)
+    ([](){
+        return crow::response(getDbMetrics());
     });
 
     // Testing Recommender
     CROW_ROUTE(app, "/api/test_recommend").methods("GET"_method)
-    ([](const crow::request& req){
+    ([](const crow::request& req, crow::response& res){
         auto type = req.url_params.get("type");
-        if (!type) return crow::response(400, "Missing type parameter.");
+        if (!type) { res.code = 400; return res.end("Missing type parameter."); }
         auto userId = req.url_params.get("userId");
-        if (!userId) return crow::response(400, "Missing userId parameter.");
+        if (!userId) { res.code = 400; return res.end("Missing userId parameter."); }
 
-        try {
-            return crow::response(rankUsers(userId, type));
-        } catch (const std::exception& e) {
-            return crow::response(500, std::string("Error: ") + e.what());
+        auto key = responseCacheKey({"rank", type, userId});
+
+#ifdef ROOMMATE_COROUTINES
+        spawnCached(req, res, key, getResponseCacheTtls().rank, asyncRankUsers(userId, type), getCompressionPolicies().rank);
+#else
+        dispatchCached(req, res, key, getResponseCacheTtls().rank, getEndpointBudgets().rank, getCompressionPolicies().rank,
+                       [userId = std::string(userId), type = std::string(type)] {
+            return jsonResponse(rankUsers(userId, type));
+        });
+#endif
+    });
+
+    // Pick the storage backend (loading a fixture) before taking traffic, then get it ready
+    // (indexes, plan check) in the background so the server listens even while MongoDB is down
+    getStorage();
+    struct Readiness {
+        std::mutex mutex;
+        bool prepared = false;
+        std::vector<std::string> problems;
+    } readiness;
+    std::thread preparer([&readiness] {
+        auto problems = getStorage().prepare();
+        std::lock_guard<std::mutex> lock(readiness.mutex);
+        readiness.problems = std::move(problems);
+        readiness.prepared = true;
+    });
+
+    // Readiness probe: fails until the storage is prepared, and after that if it reported problems
+    CROW_ROUTE(app, "/api/ready").methods("GET"_method)
+    ([&readiness](){
+        std::lock_guard<std::mutex> lock(readiness.mutex);
+        crow::json::wvalue result;
+        result["ready"] = readiness.prepared && readiness.problems.empty();
+        if (!readiness.prepared) {
+            result["problems"][0] = "Storage is being prepared.";
+            return crow::response(503, result);
         }
+        if (readiness.problems.empty()) return crow::response(result);
+
+        for (size_t i = 0; i < readiness.problems.size(); ++i) {
+            result["problems"][i] = readiness.problems[i];
+        }
+        return crow::response(503, result);
     });
 
     std::cout << "🟢 Backend starting on 0.0.0.0:18080\n";
@@ -61,4 +332,9 @@ int main() {
     // test();
 
     app.bindaddr("0.0.0.0").port(18080).multithreaded().run();
+    preparer.join();
+
+    // Finish queued DB work, then write out swipe counters still held in memory
+    getDbExecutor().stop();
+    getPopularityAggregator().stop();
 }